@@ -69,6 +69,9 @@
 #define KVM_GUESTDBG_BLOCKIRQ 0
 #endif
 
+/* Default number of memslots allocated per address space, grows on demand */
+#define KVM_MEMSLOTS_NR_ALLOC_DEFAULT 16
+
 //#define DEBUG_KVM
 
 #ifdef DEBUG_KVM
@@ -178,21 +181,47 @@ int kvm_get_max_memslots(void)
 {
     KVMState *s = KVM_STATE(current_accel());
 
-    return s->nr_slots;
+    return s->nr_slots_max;
+}
+
+/* Called with KVMMemoryListener.slots_lock held */
+static void kvm_slots_grow(KVMMemoryListener *kml, int nr_slots_new)
+{
+    int i, cur = kml->nr_slots_allocated;
+
+    assert(nr_slots_new > cur && nr_slots_new <= kvm_state->nr_slots_max);
+
+    kml->slots = g_renew(KVMSlot, kml->slots, nr_slots_new);
+    memset(&kml->slots[cur], 0, (nr_slots_new - cur) * sizeof(KVMSlot));
+    for (i = cur; i < nr_slots_new; i++) {
+        kml->slots[i].slot = i;
+    }
+    kml->nr_slots_allocated = nr_slots_new;
+    trace_kvm_slots_grow(kml->as_id, cur, nr_slots_new);
 }
 
 /* Called with KVMMemoryListener.slots_lock held */
 static KVMSlot *kvm_get_free_slot(KVMMemoryListener *kml)
 {
-    KVMState *s = kvm_state;
-    int i;
+    int i, cur = kml->nr_slots_allocated;
 
-    for (i = 0; i < s->nr_slots; i++) {
-        if (kml->slots[i].memory_size == 0) {
-            return &kml->slots[i];
+    if (kml->nr_slots_used < cur) {
+        for (i = 0; i < cur; i++) {
+            if (kml->slots[i].memory_size == 0) {
+                return &kml->slots[i];
+            }
         }
     }
 
+    /*
+     * Only size the array for the slots actually used, so that walking all
+     * slots stays cheap even if KVM supports tens of thousands of them.
+     */
+    if (cur < kvm_state->nr_slots_max) {
+        kvm_slots_grow(kml, MIN(cur * 2, kvm_state->nr_slots_max));
+        return &kml->slots[cur];
+    }
+
     return NULL;
 }
 
@@ -203,7 +232,7 @@ bool kvm_has_free_slot(MachineState *ms)
     KVMMemoryListener *kml = &s->memory_listener;
 
     kvm_slots_lock();
-    result = !!kvm_get_free_slot(kml);
+    result = kml->nr_slots_used < s->nr_slots_max;
     kvm_slots_unlock();
 
     return result;
@@ -215,6 +244,7 @@ static KVMSlot *kvm_alloc_slot(KVMMemoryListener *kml)
     KVMSlot *slot = kvm_get_free_slot(kml);
 
     if (slot) {
+        kml->nr_slots_used++;
         return slot;
     }
 
@@ -226,10 +256,9 @@ static KVMSlot *kvm_lookup_matching_slot(KVMMemoryListener *kml,
                                          hwaddr start_addr,
                                          hwaddr size)
 {
-    KVMState *s = kvm_state;
     int i;
 
-    for (i = 0; i < s->nr_slots; i++) {
+    for (i = 0; i < kml->nr_slots_allocated; i++) {
         KVMSlot *mem = &kml->slots[i];
 
         if (start_addr == mem->start_addr && size == mem->memory_size) {
@@ -271,7 +300,7 @@ int kvm_physical_memory_addr_from_host(KVMState *s, void *ram,
     int i, ret = 0;
 
     kvm_slots_lock();
-    for (i = 0; i < s->nr_slots; i++) {
+    for (i = 0; i < kml->nr_slots_allocated; i++) {
         KVMSlot *mem = &kml->slots[i];
 
         if (ram >= mem->ram && ram < mem->ram + mem->memory_size) {
@@ -347,7 +376,11 @@ static int do_kvm_destroy_vcpu(CPUState *cpu)
     }
 
     if (cpu->kvm_dirty_gfns) {
+        /* Other vCPUs and the reaper walk the rings without the BQL */
+        kvm_slots_lock();
         ret = munmap(cpu->kvm_dirty_gfns, s->kvm_dirty_ring_bytes);
+        cpu->kvm_dirty_gfns = NULL;
+        kvm_slots_unlock();
         if (ret < 0) {
             goto err;
         }
@@ -635,6 +668,9 @@ static void kvm_dirty_ring_mark_page(KVMState *s, uint32_t as_id,
     }
 
     kml = s->as[as_id].ml;
+    if (slot_id >= kml->nr_slots_allocated) {
+        return;
+    }
     mem = &kml->slots[slot_id];
 
     if (!mem->memory_size || offset >=
@@ -688,9 +724,9 @@ static uint32_t kvm_dirty_ring_reap_one(KVMState *s, CPUState *cpu)
     /*
      * It's possible that we race with vcpu creation code where the vcpu is
      * put onto the vcpus list but not yet initialized the dirty ring
-     * structures.  If so, skip it.
+     * structures, or with its destruction.  If so, skip it.
      */
-    if (!cpu->created) {
+    if (!cpu->created || !dirty_gfns) {
         return 0;
     }
 
@@ -727,6 +763,7 @@ static uint64_t kvm_dirty_ring_reap_locked(KVMState *s, CPUState* cpu)
     if (cpu) {
         total = kvm_dirty_ring_reap_one(s, cpu);
     } else {
+        RCU_READ_LOCK_GUARD();
         CPU_FOREACH(cpu) {
             total += kvm_dirty_ring_reap_one(s, cpu);
         }
@@ -747,8 +784,11 @@ static uint64_t kvm_dirty_ring_reap_locked(KVMState *s, CPUState* cpu)
 }
 
 /*
- * Currently for simplicity, we must hold BQL before calling this.  We can
- * consider to drop the BQL if we're clear with all the race conditions.
+ * Reap the dirty ring of @cpu, or of all vCPUs if @cpu is NULL.  The BQL is
+ * not needed: the rings, the fetch indexes and the slot bitmaps are all
+ * protected by the slots lock.  vCPU threads use this to reap their own ring
+ * when it fills up, in parallel with each other up to the short critical
+ * section below.
  */
 static uint64_t kvm_dirty_ring_reap(KVMState *s, CPUState *cpu)
 {
@@ -790,6 +830,14 @@ static void kvm_cpu_synchronize_kick_all(void)
 {
     CPUState *cpu;
 
+    /*
+     * Kick everybody first so that the vcpus leave guest mode in parallel,
+     * then wait for each of them.  Work items run in order, so the second
+     * one completes only after the vcpu went through userspace.
+     */
+    CPU_FOREACH(cpu) {
+        async_run_on_cpu(cpu, do_kvm_cpu_synchronize_kick, RUN_ON_CPU_NULL);
+    }
     CPU_FOREACH(cpu) {
         run_on_cpu(cpu, do_kvm_cpu_synchronize_kick, RUN_ON_CPU_NULL);
     }
@@ -1002,7 +1050,7 @@ static int kvm_physical_log_clear(KVMMemoryListener *kml,
 
     kvm_slots_lock();
 
-    for (i = 0; i < s->nr_slots; i++) {
+    for (i = 0; i < kml->nr_slots_allocated; i++) {
         mem = &kml->slots[i];
         /* Discard slots that are empty or do not overlap the section */
         if (!mem->memory_size ||
@@ -1360,7 +1408,7 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
                  * Not easy.  Let's cross the fingers until it's fixed.
                  */
                 if (kvm_state->kvm_dirty_ring_size) {
-                    kvm_dirty_ring_reap_locked(kvm_state, NULL);
+                    /* The rings were reaped by kvm_region_commit() */
                     if (kvm_state->kvm_dirty_ring_with_bitmap) {
                         kvm_slot_sync_dirty_pages(mem);
                         kvm_slot_get_dirty_log(kvm_state, mem);
@@ -1382,6 +1430,7 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
                         __func__, strerror(-err));
                 abort();
             }
+            kml->nr_slots_used--;
             start_addr += slot_size;
             size -= slot_size;
         } while (size);
@@ -1437,9 +1486,7 @@ static void *kvm_dirty_ring_reaper_thread(void *data)
         trace_kvm_dirty_ring_reaper("wakeup");
         r->reaper_state = KVM_DIRTY_RING_REAPER_REAPING;
 
-        qemu_mutex_lock_iothread();
         kvm_dirty_ring_reap(s, NULL);
-        qemu_mutex_unlock_iothread();
 
         r->reaper_iteration++;
     }
@@ -1590,6 +1637,17 @@ static void kvm_region_commit(MemoryListener *listener)
     }
 
     kvm_slots_lock();
+
+    /*
+     * Removing a slot that logs dirty pages must not lose dirty bits still
+     * sitting in the vCPU dirty rings. Collect them once for the whole
+     * transaction rather than once for every slot that goes away.
+     */
+    if (kvm_state->kvm_dirty_ring_size &&
+        !QSIMPLEQ_EMPTY(&kml->transaction_del)) {
+        kvm_dirty_ring_reap_locked(kvm_state, NULL);
+    }
+
     if (need_inhibit) {
         accel_ioctl_inhibit_begin();
     }
@@ -1640,12 +1698,8 @@ static void kvm_log_sync_global(MemoryListener *l, bool last_stage)
     /* Flush all kernel dirty addresses into KVMSlot dirty bitmap */
     kvm_dirty_ring_flush();
 
-    /*
-     * TODO: make this faster when nr_slots is big while there are
-     * only a few used slots (small VMs).
-     */
     kvm_slots_lock();
-    for (i = 0; i < s->nr_slots; i++) {
+    for (i = 0; i < kml->nr_slots_allocated; i++) {
         mem = &kml->slots[i];
         if (mem->memory_size && mem->flags & KVM_MEM_LOG_DIRTY_PAGES) {
             kvm_slot_sync_dirty_pages(mem);
@@ -1760,12 +1814,9 @@ void kvm_memory_listener_register(KVMState *s, KVMMemoryListener *kml,
 {
     int i;
 
-    kml->slots = g_new0(KVMSlot, s->nr_slots);
     kml->as_id = as_id;
 
-    for (i = 0; i < s->nr_slots; i++) {
-        kml->slots[i].slot = i;
-    }
+    kvm_slots_grow(kml, MIN(KVM_MEMSLOTS_NR_ALLOC_DEFAULT, s->nr_slots_max));
 
     QSIMPLEQ_INIT(&kml->transaction_add);
     QSIMPLEQ_INIT(&kml->transaction_del);
@@ -2500,11 +2551,11 @@ static int kvm_init(MachineState *ms)
     }
 
     kvm_immediate_exit = kvm_check_extension(s, KVM_CAP_IMMEDIATE_EXIT);
-    s->nr_slots = kvm_check_extension(s, KVM_CAP_NR_MEMSLOTS);
+    s->nr_slots_max = kvm_check_extension(s, KVM_CAP_NR_MEMSLOTS);
 
     /* If unspecified, use the default value */
-    if (!s->nr_slots) {
-        s->nr_slots = 32;
+    if (!s->nr_slots_max) {
+        s->nr_slots_max = 32;
     }
 
     s->nr_as = kvm_check_extension(s, KVM_CAP_MULTI_ADDRESS_SPACE);
@@ -3063,19 +3114,15 @@ int kvm_cpu_exec(CPUState *cpu)
              * still full.  Got kicked by KVM_RESET_DIRTY_RINGS.
              */
             trace_kvm_dirty_ring_full(cpu->cpu_index);
-            qemu_mutex_lock_iothread();
             /*
-             * We throttle vCPU by making it sleep once it exit from kernel
-             * due to dirty ring full. In the dirtylimit scenario, reaping
-             * all vCPUs after a single vCPU dirty ring get full result in
-             * the miss of sleep, so just reap the ring-fulled vCPU.
+             * Reap only the ring that got full, and without the BQL, so
+             * that vCPUs filling their rings at the same time don't wait
+             * for each other's rings or for the main loop.  The other rings
+             * are reaped when they fill up or by the reaper thread.  This
+             * is also what dirtylimit needs to throttle the vCPU by making
+             * it sleep below.
              */
-            if (dirtylimit_in_service()) {
-                kvm_dirty_ring_reap(kvm_state, cpu);
-            } else {
-                kvm_dirty_ring_reap(kvm_state, NULL);
-            }
-            qemu_mutex_unlock_iothread();
+            kvm_dirty_ring_reap(kvm_state, cpu);
             dirtylimit_vcpu_execute(cpu);
             ret = 0;
             break;
@@ -237,58 +237,82 @@ static TranslationBlock *tb_htable_lookup(CPUState *cpu, target_ulong pc,
     return qht_lookup_custom(&tb_ctx.htable, &desc, h, tb_lookup_cmp);
 }
 
+/*
+ * Insert @tb as the most recent entry in its jump cache set, demoting
+ * the previous most recent entry.  A racing invalidation may leave the
+ * demoted entry pointing to an invalidated TB, exactly as with a racing
+ * insertion; tb_lookup rejects those via CF_INVALID.
+ */
+static inline void tb_jmp_cache_insert(CPUState *cpu, target_ulong pc,
+                                       TranslationBlock *tb, uint32_t cflags)
+{
+    uint32_t hash = tb_jmp_cache_hash_func(pc);
+    CPUJumpCacheEntry *set = cpu->tb_jmp_cache->array[hash];
+    int i;
+
+    if (cflags & CF_PCREL) {
+        for (i = TB_JMP_CACHE_WAYS - 1; i > 0; i--) {
+            set[i].pc = set[i - 1].pc;
+            qatomic_store_release(&set[i].tb, qatomic_read(&set[i - 1].tb));
+        }
+        set[0].pc = pc;
+        /* Ensure pc is written first. */
+        qatomic_store_release(&set[0].tb, tb);
+    } else {
+        for (i = TB_JMP_CACHE_WAYS - 1; i > 0; i--) {
+            qatomic_set(&set[i].tb, qatomic_read(&set[i - 1].tb));
+        }
+        /* Use the pc value already stored in tb->pc. */
+        qatomic_set(&set[0].tb, tb);
+    }
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *tb_lookup(CPUState *cpu, target_ulong pc,
                                           target_ulong cs_base,
                                           uint32_t flags, uint32_t cflags)
 {
     TranslationBlock *tb;
-    CPUJumpCache *jc;
-    uint32_t hash;
+    CPUJumpCacheEntry *set;
+    int i;
 
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(pc);
-    jc = cpu->tb_jmp_cache;
+    set = cpu->tb_jmp_cache->array[tb_jmp_cache_hash_func(pc)];
 
-    if (cflags & CF_PCREL) {
-        /* Use acquire to ensure current load of pc from jc. */
-        tb = qatomic_load_acquire(&jc->array[hash].tb);
-
-        if (likely(tb &&
-                   jc->array[hash].pc == pc &&
-                   tb->cs_base == cs_base &&
-                   tb->flags == flags &&
-                   tb_cflags(tb) == cflags)) {
-            return tb;
-        }
-        tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
-        if (tb == NULL) {
-            return NULL;
-        }
-        jc->array[hash].pc = pc;
-        /* Ensure pc is written first. */
-        qatomic_store_release(&jc->array[hash].tb, tb);
-    } else {
-        /* Use rcu_read to ensure current load of pc from *tb. */
-        tb = qatomic_rcu_read(&jc->array[hash].tb);
-
-        if (likely(tb &&
-                   tb->pc == pc &&
-                   tb->cs_base == cs_base &&
-                   tb->flags == flags &&
-                   tb_cflags(tb) == cflags)) {
-            return tb;
-        }
-        tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
-        if (tb == NULL) {
-            return NULL;
+    for (i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+        if (cflags & CF_PCREL) {
+            /* Use acquire to ensure current load of pc from jc. */
+            tb = qatomic_load_acquire(&set[i].tb);
+
+            if (likely(tb &&
+                       set[i].pc == pc &&
+                       tb->cs_base == cs_base &&
+                       tb->flags == flags &&
+                       tb_cflags(tb) == cflags)) {
+                return tb;
+            }
+        } else {
+            /* Use rcu_read to ensure current load of pc from *tb. */
+            tb = qatomic_rcu_read(&set[i].tb);
+
+            if (likely(tb &&
+                       tb->pc == pc &&
+                       tb->cs_base == cs_base &&
+                       tb->flags == flags &&
+                       tb_cflags(tb) == cflags)) {
+                return tb;
+            }
         }
-        /* Use the pc value already stored in tb->pc. */
-        qatomic_set(&jc->array[hash].tb, tb);
     }
 
+    tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
+    if (tb == NULL) {
+        return NULL;
+    }
+    tb_jmp_cache_insert(cpu, pc, tb, cflags);
+
     return tb;
 }
 
@@ -967,9 +991,6 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
 
             tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
             if (tb == NULL) {
-                CPUJumpCache *jc;
-                uint32_t h;
-
                 mmap_lock();
                 tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
                 mmap_unlock();
@@ -978,16 +999,7 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                h = tb_jmp_cache_hash_func(pc);
-                jc = cpu->tb_jmp_cache;
-                if (cflags & CF_PCREL) {
-                    jc->array[h].pc = pc;
-                    /* Ensure pc is written first. */
-                    qatomic_store_release(&jc->array[h].tb, tb);
-                } else {
-                    /* Use the pc value already stored in tb->pc. */
-                    qatomic_set(&jc->array[h].tb, tb);
-                }
+                tb_jmp_cache_insert(cpu, pc, tb, cflags);
             }
 
 #ifndef CONFIG_USER_ONLY
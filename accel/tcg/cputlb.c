@@ -102,7 +102,7 @@ static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
 static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
 {
     CPUJumpCache *jc = cpu->tb_jmp_cache;
-    int i, i0;
+    int i, j, i0;
 
     if (unlikely(!jc)) {
         return;
@@ -110,7 +110,9 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
 
     i0 = tb_jmp_cache_hash_page(page_addr);
     for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
-        qatomic_set(&jc->array[i0 + i].tb, NULL);
+        for (j = 0; j < TB_JMP_CACHE_WAYS; j++) {
+            qatomic_set(&jc->array[i0 + i][j].tb, NULL);
+        }
     }
 }
 
@@ -1375,7 +1377,9 @@ static uint64_t io_readx(CPUArchState *env, CPUTLBEntryFull *full,
         cpu_io_recompile(cpu, retaddr);
     }
 
-    {
+    if (mr->lockless_io) {
+        r = memory_region_dispatch_read(mr, mr_offset, &val, op, full->attrs);
+    } else {
         QEMU_IOTHREAD_LOCK_GUARD();
         r = memory_region_dispatch_read(mr, mr_offset, &val, op, full->attrs);
     }
@@ -1430,7 +1434,9 @@ static void io_writex(CPUArchState *env, CPUTLBEntryFull *full,
      */
     save_iotlb_data(cpu, section, mr_offset);
 
-    {
+    if (mr->lockless_io) {
+        r = memory_region_dispatch_write(mr, mr_offset, val, op, full->attrs);
+    } else {
         QEMU_IOTHREAD_LOCK_GUARD();
         r = memory_region_dispatch_write(mr, mr_offset, val, op, full->attrs);
     }
@@ -12,17 +12,27 @@
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
 
+/*
+ * Each hash bucket is a set of TB_JMP_CACHE_WAYS entries, most recently
+ * inserted first, so that e.g. the targets of an indirect branch that
+ * alternate between two TBs with colliding hashes both stay cached.
+ */
+#define TB_JMP_CACHE_WAYS 2
+
 /*
  * Accessed in parallel; all accesses to 'tb' must be atomic.
  * For CF_PCREL, accesses to 'pc' must be protected by a
  * load_acquire/store_release to 'tb'.
+ * Only the owning cpu inserts entries; other threads only clear 'tb'.
  */
+typedef struct CPUJumpCacheEntry {
+    TranslationBlock *tb;
+    target_ulong pc;
+} CPUJumpCacheEntry;
+
 struct CPUJumpCache {
     struct rcu_head rcu;
-    struct {
-        TranslationBlock *tb;
-        target_ulong pc;
-    } array[TB_JMP_CACHE_SIZE];
+    CPUJumpCacheEntry array[TB_JMP_CACHE_SIZE][TB_JMP_CACHE_WAYS];
 };
 
 #endif /* ACCEL_TCG_TB_JMP_CACHE_H */
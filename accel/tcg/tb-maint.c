@@ -857,10 +857,12 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
         uint32_t h = tb_jmp_cache_hash_func(tb->pc);
 
         CPU_FOREACH(cpu) {
-            CPUJumpCache *jc = cpu->tb_jmp_cache;
+            CPUJumpCacheEntry *set = cpu->tb_jmp_cache->array[h];
 
-            if (qatomic_read(&jc->array[h].tb) == tb) {
-                qatomic_set(&jc->array[h].tb, NULL);
+            for (int i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+                if (qatomic_read(&set[i].tb) == tb) {
+                    qatomic_set(&set[i].tb, NULL);
+                }
             }
         }
     }
@@ -796,7 +796,9 @@ void tcg_flush_jmp_cache(CPUState *cpu)
     }
 
     for (int i = 0; i < TB_JMP_CACHE_SIZE; i++) {
-        qatomic_set(&jc->array[i].tb, NULL);
+        for (int j = 0; j < TB_JMP_CACHE_WAYS; j++) {
+            qatomic_set(&jc->array[i][j].tb, NULL);
+        }
     }
 }
 
@@ -209,6 +209,86 @@ static void host_memory_backend_set_dump(Object *obj, bool value, Error **errp)
     }
 }
 
+#ifdef CONFIG_NUMA
+static ThreadContext *host_memory_backend_node_context(HostMemoryBackend *b,
+                                                       unsigned long node)
+{
+    g_autofree char *name = g_strdup_printf("prealloc-node%lu", node);
+    g_autofree char *affinity = g_strdup_printf("%lu", node);
+    Object *obj = object_new(TYPE_THREAD_CONTEXT);
+
+    object_property_add_child(OBJECT(b), name, obj);
+    object_unref(obj);
+    if (!object_property_parse(obj, "node-affinity", affinity, NULL) ||
+        !user_creatable_complete(USER_CREATABLE(obj), NULL)) {
+        object_unparent(obj);
+        return NULL;
+    }
+    return THREAD_CONTEXT(obj);
+}
+#endif
+
+/*
+ * Preallocate the whole backend. With @async, preallocation may still be
+ * running when returning; see qemu_finish_async_prealloc_mem().
+ */
+static void host_memory_backend_prealloc(HostMemoryBackend *backend,
+                                         bool async, Error **errp)
+{
+    int fd = memory_region_get_fd(&backend->mr);
+    char *ptr = memory_region_get_ram_ptr(&backend->mr);
+    uint64_t sz = memory_region_size(&backend->mr);
+    QemuPreallocOptions opts = {
+        .max_threads = backend->prealloc_threads,
+        .tc = backend->prealloc_context,
+        .async = async,
+        .name = object_get_canonical_path_component(OBJECT(backend)),
+        .collapse = backend->thp_collapse,
+    };
+#ifdef CONFIG_NUMA
+    long nodes = bitmap_count_one(backend->host_nodes, MAX_NODES);
+
+    /*
+     * If the policy spans multiple host nodes and the user didn't ask for a
+     * specific prealloc-context, give each node an equal share of the area
+     * and preallocate it from threads running on that node: the kernel
+     * allocates from the faulting thread's node when the policy allows for
+     * it, so the memory is spread evenly and zeroed using node-local
+     * bandwidth. The per-node jobs only run in parallel when asynchronous.
+     */
+    if (async && nodes > 1 && !backend->prealloc_context &&
+        backend->policy != HOST_MEM_POLICY_DEFAULT && numa_available() >= 0) {
+        const uint64_t part = ROUND_UP(DIV_ROUND_UP(sz, nodes),
+                                       host_memory_backend_pagesize(backend));
+        unsigned long node;
+
+        opts.max_threads = MAX(1, backend->prealloc_threads / nodes);
+
+        for (node = find_first_bit(backend->host_nodes, MAX_NODES);
+             node < MAX_NODES && sz;
+             node = find_next_bit(backend->host_nodes, MAX_NODES, node + 1)) {
+            const uint64_t len = MIN(part, sz);
+            Error *local_err = NULL;
+
+            /* Threads inherit the affinity when created; drop it after. */
+            opts.tc = host_memory_backend_node_context(backend, node);
+            qemu_prealloc_mem(fd, ptr, len, &opts, &local_err);
+            if (opts.tc) {
+                object_unparent(OBJECT(opts.tc));
+            }
+            if (local_err) {
+                error_propagate(errp, local_err);
+                return;
+            }
+            ptr += len;
+            sz -= len;
+        }
+        return;
+    }
+#endif
+    qemu_prealloc_mem(fd, ptr, sz, &opts, errp);
+}
+
 static bool host_memory_backend_get_prealloc(Object *obj, Error **errp)
 {
     HostMemoryBackend *backend = MEMORY_BACKEND(obj);
@@ -233,12 +313,7 @@ static void host_memory_backend_set_prealloc(Object *obj, bool value,
     }
 
     if (value && !backend->prealloc) {
-        int fd = memory_region_get_fd(&backend->mr);
-        void *ptr = memory_region_get_ram_ptr(&backend->mr);
-        uint64_t sz = memory_region_size(&backend->mr);
-
-        qemu_prealloc_mem(fd, ptr, sz, backend->prealloc_threads,
-                          backend->prealloc_context, &local_err);
+        host_memory_backend_prealloc(backend, false, &local_err);
         if (local_err) {
             error_propagate(errp, local_err);
             return;
@@ -399,9 +474,14 @@ host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
          * specified NUMA policy in place.
          */
         if (backend->prealloc) {
-            qemu_prealloc_mem(memory_region_get_fd(&backend->mr), ptr, sz,
-                              backend->prealloc_threads,
-                              backend->prealloc_context, &local_err);
+            /*
+             * Until the machine is ready, let preallocation run in the
+             * background while devices are created and firmware is loaded;
+             * qemu_machine_creation_done() waits for it to finish.
+             */
+            host_memory_backend_prealloc(backend,
+                                         !phase_check(PHASE_MACHINE_READY),
+                                         &local_err);
             if (local_err) {
                 goto out;
             }
@@ -461,6 +541,25 @@ static void host_memory_backend_set_reserve(Object *o, bool value, Error **errp)
     }
     backend->reserve = value;
 }
+
+static bool host_memory_backend_get_thp_collapse(Object *o, Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(o);
+
+    return backend->thp_collapse;
+}
+
+static void host_memory_backend_set_thp_collapse(Object *o, bool value,
+                                                 Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(o);
+
+    if (host_memory_backend_mr_inited(backend)) {
+        error_setg(errp, "cannot change property value");
+        return;
+    }
+    backend->thp_collapse = value;
+}
 #endif /* CONFIG_LINUX */
 
 static bool
@@ -541,6 +640,11 @@ host_memory_backend_class_init(ObjectClass *oc, void *data)
         host_memory_backend_get_reserve, host_memory_backend_set_reserve);
     object_class_property_set_description(oc, "reserve",
         "Reserve swap space (or huge pages) if applicable");
+    object_class_property_add_bool(oc, "thp-collapse",
+        host_memory_backend_get_thp_collapse,
+        host_memory_backend_set_thp_collapse);
+    object_class_property_set_description(oc, "thp-collapse",
+        "Collapse preallocated memory into transparent huge pages");
 #endif /* CONFIG_LINUX */
     /*
      * Do not delete/rename option. This option must be considered stable
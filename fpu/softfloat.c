@@ -241,6 +241,23 @@ static inline bool can_use_fpu(const float_status *s)
                   s->float_rounding_mode == float_round_nearest_even);
 }
 
+/*
+ * Conversions to integer and round-to-integral take their rounding mode
+ * as an argument.  The host computes round-to-nearest-even (rint, with the
+ * host FPU left in its default mode) and round-to-zero (trunc) directly.
+ * As with can_use_fpu, we rely on inexact already being set.
+ */
+static inline bool can_use_fpu_rmode(const float_status *s,
+                                     FloatRoundMode rmode)
+{
+    if (QEMU_NO_HARDFLOAT) {
+        return false;
+    }
+    return likely(s->float_exception_flags & float_flag_inexact &&
+                  (rmode == float_round_nearest_even ||
+                   rmode == float_round_to_zero));
+}
+
 /*
  * Hardfloat generation functions. Each operation can have two flavors:
  * either using softfloat primitives (e.g. float32_is_zero_or_normal) for
@@ -2805,7 +2822,8 @@ float16 float64_to_float16(float64 a, bool ieee, float_status *s)
     return float16a_round_pack_canonical(&p, s, fmt);
 }
 
-float32 float64_to_float32(float64 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float64_to_float32(float64 a, float_status *s)
 {
     FloatParts64 p;
 
@@ -2814,6 +2832,38 @@ float32 float64_to_float32(float64 a, float_status *s)
     return float32_round_pack_canonical(&p, s);
 }
 
+float32 float64_to_float32(float64 a, float_status *s)
+{
+    union_float64 ud;
+    union_float32 uf;
+
+    if (unlikely(!can_use_fpu(s))) {
+        goto soft;
+    }
+
+    ud.s = a;
+    if (float64_is_zero(ud.s)) {
+        return float32_set_sign(float32_zero, float64_is_neg(ud.s));
+    }
+    if (unlikely(!float64_is_normal(ud.s))) {
+        goto soft;
+    }
+
+    /*
+     * Any result that overflows or lands in the float32 denormal range
+     * needs the softfloat path for overflow/underflow flags and for
+     * flush-to-zero handling.
+     */
+    uf.h = ud.h;
+    if (unlikely(isinf(uf.h) || fabsf(uf.h) <= FLT_MIN)) {
+        goto soft;
+    }
+    return uf.s;
+
+ soft:
+    return soft_float64_to_float32(a, s);
+}
+
 float32 bfloat16_to_float32(bfloat16 a, float_status *s)
 {
     FloatParts64 p;
@@ -2957,6 +3007,40 @@ floatx80 float128_to_floatx80(float128 a, float_status *s)
     return floatx80_round_pack_canonical(&p, s);
 }
 
+/*
+ * Host rounding and conversions to integer, used for the common case of
+ * a normal or zero input, no scaling and a result that is in range.
+ * Everything else, including all cases that raise invalid, is left to
+ * softfloat.
+ */
+static inline double hard_round_to_int(double d, FloatRoundMode rmode)
+{
+    return rmode == float_round_to_zero ? trunc(d) : rint(d);
+}
+
+static inline bool hard_to_sint(double d, FloatRoundMode rmode,
+                                int64_t min, int64_t max, int64_t *ret)
+{
+    d = hard_round_to_int(d, rmode);
+    /* Note that (double)max + 1 is exact for int32 and int64 limits. */
+    if (likely(d >= (double)min && d < (double)max + 1)) {
+        *ret = (int64_t)d;
+        return true;
+    }
+    return false;
+}
+
+static inline bool hard_to_uint(double d, FloatRoundMode rmode,
+                                uint64_t max, uint64_t *ret)
+{
+    d = hard_round_to_int(d, rmode);
+    if (likely(d >= 0 && d < (double)max + 1)) {
+        *ret = (uint64_t)d;
+        return true;
+    }
+    return false;
+}
+
 /*
  * Round to integral value
  */
@@ -2974,6 +3058,16 @@ float32 float32_round_to_int(float32 a, float_status *s)
 {
     FloatParts64 p;
 
+    if (can_use_fpu_rmode(s, s->float_rounding_mode)) {
+        union_float32 u;
+
+        u.s = a;
+        if (likely(float32_is_zero_or_normal(u.s))) {
+            u.h = hard_round_to_int(u.h, s->float_rounding_mode);
+            return u.s;
+        }
+    }
+
     float32_unpack_canonical(&p, a, s);
     parts_round_to_int(&p, s->float_rounding_mode, 0, s, &float32_params);
     return float32_round_pack_canonical(&p, s);
@@ -2983,6 +3077,16 @@ float64 float64_round_to_int(float64 a, float_status *s)
 {
     FloatParts64 p;
 
+    if (can_use_fpu_rmode(s, s->float_rounding_mode)) {
+        union_float64 u;
+
+        u.s = a;
+        if (likely(float64_is_zero_or_normal(u.s))) {
+            u.h = hard_round_to_int(u.h, s->float_rounding_mode);
+            return u.s;
+        }
+    }
+
     float64_unpack_canonical(&p, a, s);
     parts_round_to_int(&p, s->float_rounding_mode, 0, s, &float64_params);
     return float64_round_pack_canonical(&p, s);
@@ -3073,6 +3177,17 @@ int32_t float32_to_int32_scalbn(float32 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu_rmode(s, rmode)) {
+        union_float32 u;
+        int64_t r;
+
+        u.s = a;
+        if (likely(float32_is_zero_or_normal(u.s)) &&
+            hard_to_sint(u.h, rmode, INT32_MIN, INT32_MAX, &r)) {
+            return r;
+        }
+    }
+
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
 }
@@ -3082,6 +3197,17 @@ int64_t float32_to_int64_scalbn(float32 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu_rmode(s, rmode)) {
+        union_float32 u;
+        int64_t r;
+
+        u.s = a;
+        if (likely(float32_is_zero_or_normal(u.s)) &&
+            hard_to_sint(u.h, rmode, INT64_MIN, INT64_MAX, &r)) {
+            return r;
+        }
+    }
+
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
 }
@@ -3100,6 +3226,17 @@ int32_t float64_to_int32_scalbn(float64 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu_rmode(s, rmode)) {
+        union_float64 u;
+        int64_t r;
+
+        u.s = a;
+        if (likely(float64_is_zero_or_normal(u.s)) &&
+            hard_to_sint(u.h, rmode, INT32_MIN, INT32_MAX, &r)) {
+            return r;
+        }
+    }
+
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
 }
@@ -3109,6 +3246,17 @@ int64_t float64_to_int64_scalbn(float64 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu_rmode(s, rmode)) {
+        union_float64 u;
+        int64_t r;
+
+        u.s = a;
+        if (likely(float64_is_zero_or_normal(u.s)) &&
+            hard_to_sint(u.h, rmode, INT64_MIN, INT64_MAX, &r)) {
+            return r;
+        }
+    }
+
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
 }
@@ -3463,6 +3611,17 @@ uint32_t float32_to_uint32_scalbn(float32 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu_rmode(s, rmode)) {
+        union_float32 u;
+        uint64_t r;
+
+        u.s = a;
+        if (likely(float32_is_zero_or_normal(u.s)) &&
+            hard_to_uint(u.h, rmode, UINT32_MAX, &r)) {
+            return r;
+        }
+    }
+
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT32_MAX, s);
 }
@@ -3472,6 +3631,17 @@ uint64_t float32_to_uint64_scalbn(float32 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu_rmode(s, rmode)) {
+        union_float32 u;
+        uint64_t r;
+
+        u.s = a;
+        if (likely(float32_is_zero_or_normal(u.s)) &&
+            hard_to_uint(u.h, rmode, UINT64_MAX, &r)) {
+            return r;
+        }
+    }
+
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT64_MAX, s);
 }
@@ -3490,6 +3660,17 @@ uint32_t float64_to_uint32_scalbn(float64 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu_rmode(s, rmode)) {
+        union_float64 u;
+        uint64_t r;
+
+        u.s = a;
+        if (likely(float64_is_zero_or_normal(u.s)) &&
+            hard_to_uint(u.h, rmode, UINT32_MAX, &r)) {
+            return r;
+        }
+    }
+
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT32_MAX, s);
 }
@@ -3499,6 +3680,17 @@ uint64_t float64_to_uint64_scalbn(float64 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu_rmode(s, rmode)) {
+        union_float64 u;
+        uint64_t r;
+
+        u.s = a;
+        if (likely(float64_is_zero_or_normal(u.s)) &&
+            hard_to_uint(u.h, rmode, UINT64_MAX, &r)) {
+            return r;
+        }
+    }
+
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT64_MAX, s);
 }
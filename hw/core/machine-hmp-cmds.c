@@ -123,6 +123,10 @@ void hmp_info_memdev(Monitor *mon, const QDict *qdict)
                        HostMemPolicy_str(m->value->policy));
         visit_complete(v, &str);
         monitor_printf(mon, "  host nodes: %s\n", str);
+        if (m->value->has_thp_size) {
+            monitor_printf(mon, "  thp size: %" PRIu64 "\n",
+                           m->value->thp_size);
+        }
 
         g_free(str);
         visit_free(v);
@@ -146,12 +146,21 @@ void qmp_set_numa_node(NumaOptions *cmd, Error **errp)
     set_numa_options(MACHINE(qdev_get_machine()), cmd, errp);
 }
 
+typedef struct MemdevQuery {
+    MemdevList *list;
+    /* Areas of the backends with memory, and the Memdev of each area */
+    GArray *thp_areas;
+    GPtrArray *thp_memdevs;
+} MemdevQuery;
+
 static int query_memdev(Object *obj, void *opaque)
 {
     Error *err = NULL;
-    MemdevList **list = opaque;
+    MemdevQuery *query = opaque;
+    HostMemoryBackend *backend;
     Memdev *m;
     QObject *host_nodes;
+    QemuThpArea area;
     Visitor *v;
 
     if (object_dynamic_cast(obj, TYPE_MEMORY_BACKEND)) {
@@ -180,7 +189,17 @@ static int query_memdev(Object *obj, void *opaque)
         visit_free(v);
         qobject_unref(host_nodes);
 
-        QAPI_LIST_PREPEND(*list, m);
+        backend = MEMORY_BACKEND(obj);
+        if (host_memory_backend_mr_inited(backend)) {
+            area = (QemuThpArea) {
+                .area = memory_region_get_ram_ptr(&backend->mr),
+                .size = memory_region_size(&backend->mr),
+            };
+            g_array_append_val(query->thp_areas, area);
+            g_ptr_array_add(query->thp_memdevs, m);
+        }
+
+        QAPI_LIST_PREPEND(query->list, m);
     }
 
     return 0;
@@ -189,10 +208,29 @@ static int query_memdev(Object *obj, void *opaque)
 MemdevList *qmp_query_memdev(Error **errp)
 {
     Object *obj = object_get_objects_root();
-    MemdevList *list = NULL;
+    MemdevQuery query = {
+        .thp_areas = g_array_new(false, false, sizeof(QemuThpArea)),
+        .thp_memdevs = g_ptr_array_new(),
+    };
+    QemuThpArea *areas;
+    Memdev *m;
+    int i;
+
+    object_child_foreach(obj, query_memdev, &query);
+
+    areas = (QemuThpArea *)query.thp_areas->data;
+    if (query.thp_areas->len &&
+        qemu_get_thp_backed_size(areas, query.thp_areas->len)) {
+        for (i = 0; i < query.thp_areas->len; i++) {
+            m = g_ptr_array_index(query.thp_memdevs, i);
+            m->has_thp_size = true;
+            m->thp_size = areas[i].thp_size;
+        }
+    }
 
-    object_child_foreach(obj, query_memdev, &list);
-    return list;
+    g_array_free(query.thp_areas, true);
+    g_ptr_array_free(query.thp_memdevs, true);
+    return query.list;
 }
 
 HumanReadableText *qmp_x_query_numa(Error **errp)
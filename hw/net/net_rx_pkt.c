@@ -47,6 +47,9 @@ struct NetRxPkt {
     eth_ip6_hdr_info ip6hdr_info;
     eth_ip4_hdr_info ip4hdr_info;
     eth_l4_hdr_info  l4hdr_info;
+
+    /* Lookup table for the last RSS key, allocated on first use */
+    NetToeplitzTable *rss_table;
 };
 
 void net_rx_pkt_init(struct NetRxPkt **pkt)
@@ -63,6 +66,7 @@ void net_rx_pkt_uninit(struct NetRxPkt *pkt)
         g_free(pkt->vec);
     }
 
+    g_free(pkt->rss_table);
     g_free(pkt);
 }
 
@@ -311,10 +315,9 @@ net_rx_pkt_calc_rss_hash(struct NetRxPkt *pkt,
                          NetRxPktRssType type,
                          uint8_t *key)
 {
-    uint8_t rss_input[36];
+    uint8_t rss_input[NET_TOEPLITZ_MAX_INPUT];
     size_t rss_length = 0;
-    uint32_t rss_hash = 0;
-    net_toeplitz_key key_data;
+    uint32_t rss_hash;
 
     switch (type) {
     case NetPktRssIpV4:
@@ -379,8 +382,14 @@ net_rx_pkt_calc_rss_hash(struct NetRxPkt *pkt,
         break;
     }
 
-    net_toeplitz_key_init(&key_data, key);
-    net_toeplitz_add(&rss_hash, rss_input, rss_length, &key_data);
+    /* Guests rarely change the key, rebuild the table when they do */
+    if (!pkt->rss_table) {
+        pkt->rss_table = g_new(NetToeplitzTable, 1);
+        net_toeplitz_table_init(pkt->rss_table, key);
+    } else if (memcmp(pkt->rss_table->key, key, NET_TOEPLITZ_KEY_SIZE)) {
+        net_toeplitz_table_init(pkt->rss_table, key);
+    }
+    rss_hash = net_toeplitz_table_hash(pkt->rss_table, rss_input, rss_length);
 
     trace_net_rx_pkt_rss_hash(rss_length, rss_hash);
 
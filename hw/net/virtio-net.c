@@ -17,9 +17,11 @@
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "qemu/xxhash.h"
 #include "hw/virtio/virtio.h"
 #include "net/net.h"
 #include "net/checksum.h"
+#include "net/eth.h"
 #include "net/tap.h"
 #include "qemu/error-report.h"
 #include "qemu/timer.h"
@@ -27,6 +29,8 @@
 #include "qemu/option_int.h"
 #include "qemu/config-file.h"
 #include "qapi/qmp/qdict.h"
+#include "qapi/qapi-builtin-visit.h"
+#include "qapi/visitor.h"
 #include "hw/virtio/virtio-net.h"
 #include "net/vhost_net.h"
 #include "net/announce.h"
@@ -46,6 +50,7 @@
 #include "net_rx_pkt.h"
 #include "hw/virtio/vhost.h"
 #include "sysemu/qtest.h"
+#include "block/aio-wait.h"
 
 #define VIRTIO_NET_VM_VERSION    11
 
@@ -222,6 +227,38 @@ static bool virtio_net_started(VirtIONet *n, uint8_t status)
         (n->status & VIRTIO_NET_S_LINK_UP) && vdev->vm_running;
 }
 
+/*
+ * Queue pairs run by an IOThread are protected by its AioContext lock.
+ * q->ctx only changes while the IOThread does not process the queue pair.
+ */
+static AioContext *virtio_net_queue_acquire(VirtIONetQueue *q)
+{
+    AioContext *ctx = q->ctx;
+
+    if (ctx) {
+        aio_context_acquire(ctx);
+    }
+    return ctx;
+}
+
+static void virtio_net_queue_release(AioContext *ctx)
+{
+    if (ctx) {
+        aio_context_release(ctx);
+    }
+}
+
+static void virtio_net_notify(VirtIONetQueue *q, VirtQueue *vq)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(q->n);
+
+    if (q->ctx) {
+        virtio_notify_irqfd(vdev, vq);
+    } else {
+        virtio_notify(vdev, vq);
+    }
+}
+
 static void virtio_net_announce_notify(VirtIONet *net)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(net);
@@ -373,18 +410,63 @@ static void virtio_net_vnet_endian_status(VirtIONet *n, uint8_t status)
     }
 }
 
-static void virtio_net_drop_tx_queue_data(VirtIODevice *vdev, VirtQueue *vq)
+static void virtio_net_drop_tx_queue_data(VirtIONetQueue *q)
 {
-    unsigned int dropped = virtqueue_drop_all(vq);
+    unsigned int dropped = virtqueue_drop_all(q->tx_vq);
     if (dropped) {
-        virtio_notify(vdev, vq);
+        virtio_net_notify(q, q->tx_vq);
+    }
+}
+
+static void virtio_net_dataplane_update(VirtIONet *n, uint8_t status);
+
+static void virtio_net_queue_set_status(VirtIONetQueue *q, int index,
+                                        uint8_t queue_status)
+{
+    VirtIONet *n = q->n;
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    NetClientState *ncs = qemu_get_subqueue(n->nic, index);
+    bool queue_started;
+
+    queue_started = virtio_net_started(n, queue_status) && !n->vhost_started;
+
+    if (queue_started) {
+        qemu_flush_queued_packets(ncs);
+    }
+
+    if (!q->tx_waiting) {
+        return;
+    }
+
+    if (queue_started) {
+        if (q->tx_timer) {
+            timer_mod(q->tx_timer,
+                      qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + n->tx_timeout);
+        } else {
+            qemu_bh_schedule(q->tx_bh);
+        }
+    } else {
+        if (q->tx_timer) {
+            timer_del(q->tx_timer);
+        } else {
+            qemu_bh_cancel(q->tx_bh);
+        }
+        if ((n->status & VIRTIO_NET_S_LINK_UP) == 0 &&
+            (queue_status & VIRTIO_CONFIG_S_DRIVER_OK) &&
+            vdev->vm_running) {
+            /* if tx is waiting we are likely have some packets in tx queue
+             * and disabled notification */
+            q->tx_waiting = 0;
+            virtio_queue_set_notification(q->tx_vq, 1);
+            virtio_net_drop_tx_queue_data(q);
+        }
     }
 }
 
 static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
-    VirtIONetQueue *q;
+    AioContext *ctx;
     int i;
     uint8_t queue_status;
 
@@ -392,50 +474,38 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
     virtio_net_vhost_status(n, status);
 
     for (i = 0; i < n->max_queue_pairs; i++) {
-        NetClientState *ncs = qemu_get_subqueue(n->nic, i);
-        bool queue_started;
-        q = &n->vqs[i];
+        VirtIONetQueue *q = &n->vqs[i];
 
         if ((!n->multiqueue && i != 0) || i >= n->curr_queue_pairs) {
             queue_status = 0;
         } else {
             queue_status = status;
         }
-        queue_started =
-            virtio_net_started(n, queue_status) && !n->vhost_started;
 
-        if (queue_started) {
-            qemu_flush_queued_packets(ncs);
-        }
+        ctx = virtio_net_queue_acquire(q);
+        virtio_net_queue_set_status(q, i, queue_status);
+        virtio_net_queue_release(ctx);
+    }
 
-        if (!q->tx_waiting) {
-            continue;
-        }
+    virtio_net_dataplane_update(n, status);
+}
 
-        if (queue_started) {
-            if (q->tx_timer) {
-                timer_mod(q->tx_timer,
-                               qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + n->tx_timeout);
-            } else {
-                qemu_bh_schedule(q->tx_bh);
-            }
-        } else {
-            if (q->tx_timer) {
-                timer_del(q->tx_timer);
-            } else {
-                qemu_bh_cancel(q->tx_bh);
-            }
-            if ((n->status & VIRTIO_NET_S_LINK_UP) == 0 &&
-                (queue_status & VIRTIO_CONFIG_S_DRIVER_OK) &&
-                vdev->vm_running) {
-                /* if tx is waiting we are likely have some packets in tx queue
-                 * and disabled notification */
-                q->tx_waiting = 0;
-                virtio_queue_set_notification(q->tx_vq, 1);
-                virtio_net_drop_tx_queue_data(vdev, q->tx_vq);
-            }
-        }
-    }
+/*
+ * Bring the queue pairs back to the main loop while device state that the
+ * IOThreads use is changed.
+ */
+static void virtio_net_dataplane_block(VirtIONet *n)
+{
+    assert(!n->dataplane_blocked);
+    n->dataplane_blocked = true;
+    virtio_net_dataplane_update(n, VIRTIO_DEVICE(n)->status);
+}
+
+static void virtio_net_dataplane_unblock(VirtIONet *n)
+{
+    assert(n->dataplane_blocked);
+    n->dataplane_blocked = false;
+    virtio_net_dataplane_update(n, VIRTIO_DEVICE(n)->status);
 }
 
 static void virtio_net_set_link_status(NetClientState *nc)
@@ -570,7 +640,9 @@ static void virtio_net_queue_reset(VirtIODevice *vdev, uint32_t queue_index)
         vhost_net_virtqueue_reset(vdev, nc, queue_index);
     }
 
+    virtio_net_dataplane_block(n);
     flush_or_purge_queued_packets(nc);
+    virtio_net_dataplane_unblock(n);
 }
 
 static void virtio_net_queue_enable(VirtIODevice *vdev, uint32_t queue_index)
@@ -956,6 +1028,24 @@ static void failover_add_primary(VirtIONet *n, Error **errp)
     error_propagate(errp, err);
 }
 
+/*
+ * Received TCP segments are coalesced for drivers that negotiated
+ * VIRTIO_NET_F_RSC_EXT.  With rx_coalesce, drivers that accept TSO get
+ * coalesced segments as regular GSO frames instead, like host GRO.
+ */
+static void virtio_net_update_rsc(VirtIONet *n, uint64_t offloads)
+{
+    bool rsc_ext = virtio_has_feature(offloads, VIRTIO_NET_F_RSC_EXT);
+    bool gro = !rsc_ext && n->rx_coalesce && n->has_vnet_hdr &&
+               virtio_has_feature(offloads, VIRTIO_NET_F_GUEST_CSUM);
+
+    n->rsc4_enabled = (rsc_ext || gro) &&
+        virtio_has_feature(offloads, VIRTIO_NET_F_GUEST_TSO4);
+    n->rsc6_enabled = (rsc_ext || gro) &&
+        virtio_has_feature(offloads, VIRTIO_NET_F_GUEST_TSO6);
+    n->rsc_gro = gro;
+}
+
 static void virtio_net_set_features(VirtIODevice *vdev, uint64_t features)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
@@ -967,6 +1057,7 @@ static void virtio_net_set_features(VirtIODevice *vdev, uint64_t features)
         features &= ~(1ULL << VIRTIO_NET_F_MTU);
     }
 
+    virtio_net_dataplane_block(n);
     virtio_net_set_multiqueue(n,
                               virtio_has_feature(features, VIRTIO_NET_F_RSS) ||
                               virtio_has_feature(features, VIRTIO_NET_F_MQ));
@@ -979,10 +1070,7 @@ static void virtio_net_set_features(VirtIODevice *vdev, uint64_t features)
                                virtio_has_feature(features,
                                                   VIRTIO_NET_F_HASH_REPORT));
 
-    n->rsc4_enabled = virtio_has_feature(features, VIRTIO_NET_F_RSC_EXT) &&
-        virtio_has_feature(features, VIRTIO_NET_F_GUEST_TSO4);
-    n->rsc6_enabled = virtio_has_feature(features, VIRTIO_NET_F_RSC_EXT) &&
-        virtio_has_feature(features, VIRTIO_NET_F_GUEST_TSO6);
+    virtio_net_update_rsc(n, features);
     n->rss_data.redirect = virtio_has_feature(features, VIRTIO_NET_F_RSS);
 
     if (n->has_vnet_hdr) {
@@ -1011,6 +1099,7 @@ static void virtio_net_set_features(VirtIODevice *vdev, uint64_t features)
     } else {
         memset(n->vlans, 0xff, MAX_VLAN >> 3);
     }
+    virtio_net_dataplane_unblock(n);
 
     if (virtio_has_feature(features, VIRTIO_NET_F_STANDBY)) {
         qapi_event_send_failover_negotiated(n->netclient_name);
@@ -1084,10 +1173,7 @@ static int virtio_net_handle_offloads(VirtIONet *n, uint8_t cmd,
             return VIRTIO_NET_ERR;
         }
 
-        n->rsc4_enabled = virtio_has_feature(offloads, VIRTIO_NET_F_RSC_EXT) &&
-            virtio_has_feature(offloads, VIRTIO_NET_F_GUEST_TSO4);
-        n->rsc6_enabled = virtio_has_feature(offloads, VIRTIO_NET_F_RSC_EXT) &&
-            virtio_has_feature(offloads, VIRTIO_NET_F_GUEST_TSO6);
+        virtio_net_update_rsc(n, offloads);
         virtio_clear_feature(&offloads, VIRTIO_NET_F_RSC_EXT);
 
         supported_offloads = virtio_net_supported_guest_offloads(n);
@@ -1557,9 +1643,37 @@ size_t virtio_net_handle_ctrl_iov(VirtIODevice *vdev,
     return sizeof(status);
 }
 
+/*
+ * Whether a control command changes state that the IOThreads use: filters,
+ * offloads and queue pairs.  Announcements and malformed or unknown
+ * commands do not.
+ */
+static bool virtio_net_ctrl_needs_block(VirtQueueElement *elem)
+{
+    struct virtio_net_ctrl_hdr ctrl;
+
+    if (iov_to_buf(elem->out_sg, elem->out_num, 0, &ctrl,
+                   sizeof(ctrl)) != sizeof(ctrl)) {
+        return false;
+    }
+
+    switch (ctrl.class) {
+    case VIRTIO_NET_CTRL_RX:
+    case VIRTIO_NET_CTRL_MAC:
+    case VIRTIO_NET_CTRL_VLAN:
+    case VIRTIO_NET_CTRL_MQ:
+    case VIRTIO_NET_CTRL_GUEST_OFFLOADS:
+        return true;
+    default:
+        return false;
+    }
+}
+
 static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
 {
+    VirtIONet *n = VIRTIO_NET(vdev);
     VirtQueueElement *elem;
+    bool blocked = false;
 
     for (;;) {
         size_t written;
@@ -1568,6 +1682,12 @@ static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
             break;
         }
 
+        /* Stays blocked for the rest of the kick, commands come in bursts */
+        if (!blocked && virtio_net_ctrl_needs_block(elem)) {
+            virtio_net_dataplane_block(n);
+            blocked = true;
+        }
+
         written = virtio_net_handle_ctrl_iov(vdev, elem->in_sg, elem->in_num,
                                              elem->out_sg, elem->out_num);
         if (written > 0) {
@@ -1580,6 +1700,9 @@ static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
             break;
         }
     }
+    if (blocked) {
+        virtio_net_dataplane_unblock(n);
+    }
 }
 
 /* RX */
@@ -1864,6 +1987,25 @@ static int virtio_net_process_rss(NetClientState *nc, const uint8_t *buf,
     return (index == new_index) ? -1 : new_index;
 }
 
+/* Publish the RX completions that were deferred by a receive batch */
+static void virtio_net_rx_flush(VirtIONetQueue *q)
+{
+    if (q->rx_pending) {
+        virtqueue_flush(q->rx_vq, q->rx_pending);
+        virtio_net_notify(q, q->rx_vq);
+        q->rx_pending = 0;
+    }
+}
+
+/*
+ * The main loop batches across the whole device because software RSS may
+ * steer packets to any queue, IOThreads only batch their own queue pair.
+ */
+static unsigned int *virtio_net_rx_batch(VirtIONetQueue *q)
+{
+    return q->ctx ? &q->rx_batch : &q->n->rx_batch;
+}
+
 static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
                                       size_t size, bool no_rss)
 {
@@ -1989,12 +2131,14 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
 
     for (j = 0; j < i; j++) {
         /* signal other side */
-        virtqueue_fill(q->rx_vq, elems[j], lens[j], j);
+        virtqueue_fill(q->rx_vq, elems[j], lens[j], q->rx_pending + j);
         g_free(elems[j]);
     }
+    q->rx_pending += i;
 
-    virtqueue_flush(q->rx_vq, i);
-    virtio_notify(vdev, q->rx_vq);
+    if (!*virtio_net_rx_batch(q)) {
+        virtio_net_rx_flush(q);
+    }
 
     return size;
 
@@ -2015,6 +2159,43 @@ static ssize_t virtio_net_do_receive(NetClientState *nc, const uint8_t *buf,
     return virtio_net_receive_rcu(nc, buf, size, false);
 }
 
+static void virtio_net_receive_batch_begin(NetClientState *nc)
+{
+    VirtIONetQueue *q = virtio_net_get_subqueue(nc);
+
+    (*virtio_net_rx_batch(q))++;
+}
+
+static void virtio_net_rsc_flush(VirtIONet *n);
+
+static void virtio_net_receive_batch_end(NetClientState *nc)
+{
+    VirtIONet *n = qemu_get_nic_opaque(nc);
+    VirtIONetQueue *q = virtio_net_get_subqueue(nc);
+    unsigned int *batch = virtio_net_rx_batch(q);
+    int i;
+
+    assert(*batch);
+    if (*batch == 1 && n->rsc_gro && !q->ctx) {
+        /* Nothing more to merge with, don't wait for the drain timer */
+        virtio_net_rsc_flush(n);
+    }
+    if (--*batch) {
+        return;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    if (q->ctx) {
+        virtio_net_rx_flush(q);
+        return;
+    }
+
+    /* Software RSS may have steered packets to any queue */
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        virtio_net_rx_flush(&n->vqs[i]);
+    }
+}
+
 static void virtio_net_rsc_extract_unit4(VirtioNetRscChain *chain,
                                          const uint8_t *buf,
                                          VirtioNetRscUnit *unit)
@@ -2051,6 +2232,96 @@ static void virtio_net_rsc_extract_unit6(VirtioNetRscChain *chain,
     unit->payload = htons(*unit->ip_plen) - unit->tcp_hdrlen;
 }
 
+static void virtio_net_rsc_flow_init(VirtioNetRscFlow *flow,
+                                     const void *addrs, size_t addrs_size,
+                                     const void *ports)
+{
+    memset(flow, 0, sizeof(*flow));
+    memcpy(flow->addrs, addrs, addrs_size);
+    memcpy(&flow->ports, ports, sizeof(flow->ports));
+}
+
+static void virtio_net_rsc_unit_flow(VirtioNetRscChain *chain,
+                                     VirtioNetRscUnit *unit,
+                                     VirtioNetRscFlow *flow)
+{
+    struct ip_header *ip4 = unit->ip;
+    struct ip6_header *ip6 = unit->ip;
+
+    if (chain->proto == ETH_P_IP) {
+        virtio_net_rsc_flow_init(flow, &ip4->ip_src,
+                                 VIRTIO_NET_IP4_ADDR_SIZE, unit->tcp);
+    } else {
+        virtio_net_rsc_flow_init(flow, &ip6->ip6_src,
+                                 VIRTIO_NET_IP6_ADDR_SIZE, unit->tcp);
+    }
+}
+
+static guint virtio_net_rsc_flow_hash(gconstpointer key)
+{
+    const VirtioNetRscFlow *flow = key;
+
+    return qemu_xxhash7(flow->addrs[0], flow->addrs[1],
+                        flow->addrs[2] ^ flow->addrs[3], flow->ports);
+}
+
+static gboolean virtio_net_rsc_flow_equal(gconstpointer a, gconstpointer b)
+{
+    return !memcmp(a, b, sizeof(VirtioNetRscFlow));
+}
+
+/*
+ * Convert a header field to the byte order the backend uses.  If the
+ * backend uses host order, receive_header() swaps the header later.
+ */
+static uint16_t virtio_net_rsc_hdr16(VirtIONet *n, uint16_t val)
+{
+    if (n->needs_vnet_hdr_swap) {
+        return val;
+    }
+    return virtio_tswap16(VIRTIO_DEVICE(n), val);
+}
+
+/*
+ * Turn a coalesced segment into a GSO frame with a partial TCP checksum,
+ * the way the host kernel passes GRO packets to tap.
+ */
+static void virtio_net_rsc_gro_finalize(VirtioNetRscChain *chain,
+                                        VirtioNetRscSeg *seg)
+{
+    VirtIONet *n = chain->n;
+    struct virtio_net_hdr *h = seg->buf;
+    VirtioNetRscUnit *unit = &seg->unit;
+    uint16_t hdr_len = n->guest_hdr_len;
+    uint16_t l4_off = (uint8_t *)unit->tcp - (uint8_t *)seg->buf - hdr_len;
+    uint16_t l4_len = unit->tcp_hdrlen + unit->payload;
+    uint32_t cntr, cso;
+
+    if (chain->proto == ETH_P_IP) {
+        eth_fix_ip4_checksum(unit->ip, sizeof(struct ip_header));
+        cntr = eth_calc_ip4_pseudo_hdr_csum(unit->ip, l4_len, &cso);
+    } else {
+        cntr = eth_calc_ip6_pseudo_hdr_csum(unit->ip, l4_len,
+                                            IP_PROTO_TCP, &cso);
+    }
+    unit->tcp->th_sum = cpu_to_be16(~net_checksum_finish(cntr));
+
+    h->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    h->csum_start = virtio_net_rsc_hdr16(n, l4_off);
+    h->csum_offset = virtio_net_rsc_hdr16(n, offsetof(struct tcp_header,
+                                                      th_sum));
+    if (seg->mss && unit->payload > seg->mss) {
+        h->gso_type = chain->gso_type;
+        h->gso_size = virtio_net_rsc_hdr16(n, seg->mss);
+        h->hdr_len = virtio_net_rsc_hdr16(n, l4_off + unit->tcp_hdrlen);
+    } else {
+        /* Only the TCP header changed, e.g. a window update */
+        h->gso_type = VIRTIO_NET_HDR_GSO_NONE;
+        h->gso_size = 0;
+        h->hdr_len = 0;
+    }
+}
+
 static size_t virtio_net_rsc_drain_seg(VirtioNetRscChain *chain,
                                        VirtioNetRscSeg *seg)
 {
@@ -2058,10 +2329,12 @@ static size_t virtio_net_rsc_drain_seg(VirtioNetRscChain *chain,
     struct virtio_net_hdr_v1 *h;
 
     h = (struct virtio_net_hdr_v1 *)seg->buf;
-    h->flags = 0;
-    h->gso_type = VIRTIO_NET_HDR_GSO_NONE;
-
-    if (seg->is_coalesced) {
+    if (chain->n->rsc_gro) {
+        /* Segments sent on their own keep the header they came with */
+        if (seg->is_coalesced) {
+            virtio_net_rsc_gro_finalize(chain, seg);
+        }
+    } else if (seg->is_coalesced) {
         h->rsc.segments = seg->packets;
         h->rsc.dup_acks = seg->dup_ack;
         h->flags = VIRTIO_NET_HDR_F_RSC_INFO;
@@ -2070,8 +2343,12 @@ static size_t virtio_net_rsc_drain_seg(VirtioNetRscChain *chain,
         } else {
             h->gso_type = VIRTIO_NET_HDR_GSO_TCPV6;
         }
+    } else {
+        h->flags = 0;
+        h->gso_type = VIRTIO_NET_HDR_GSO_NONE;
     }
 
+    g_hash_table_remove(chain->flows, &seg->flow);
     ret = virtio_net_do_receive(seg->nc, seg->buf, seg->size);
     QTAILQ_REMOVE(&chain->buffers, seg, next);
     g_free(seg->buf);
@@ -2099,6 +2376,23 @@ static void virtio_net_rsc_purge(void *opq)
     }
 }
 
+static void virtio_net_rsc_flush(VirtIONet *n)
+{
+    VirtioNetRscChain *chain;
+    VirtioNetRscSeg *seg, *rn;
+
+    QTAILQ_FOREACH(chain, &n->rsc_chains, next) {
+        QTAILQ_FOREACH_SAFE(seg, &chain->buffers, next, rn) {
+            if (virtio_net_rsc_drain_seg(chain, seg) == 0) {
+                chain->stat.purge_failed++;
+            }
+        }
+        if (QTAILQ_EMPTY(&chain->buffers)) {
+            timer_del(chain->drain_timer);
+        }
+    }
+}
+
 static void virtio_net_rsc_cleanup(VirtIONet *n)
 {
     VirtioNetRscChain *chain, *rn_chain;
@@ -2111,6 +2405,7 @@ static void virtio_net_rsc_cleanup(VirtIONet *n)
             g_free(seg);
         }
 
+        g_hash_table_destroy(chain->flows);
         timer_free(chain->drain_timer);
         QTAILQ_REMOVE(&n->rsc_chains, chain, next);
         g_free(chain);
@@ -2148,6 +2443,30 @@ static void virtio_net_rsc_cache_buf(VirtioNetRscChain *chain,
     default:
         g_assert_not_reached();
     }
+    seg->mss = seg->unit.payload;
+    virtio_net_rsc_unit_flow(chain, &seg->unit, &seg->flow);
+    g_hash_table_insert(chain->flows, &seg->flow, seg);
+}
+
+/*
+ * GSO frames must consist of equally sized segments but the last one, with
+ * identical TCP options.
+ */
+static bool virtio_net_rsc_gro_can_merge(VirtioNetRscSeg *seg,
+                                         VirtioNetRscUnit *n_unit)
+{
+    VirtioNetRscUnit *o_unit = &seg->unit;
+
+    if (n_unit->tcp_hdrlen != o_unit->tcp_hdrlen ||
+        memcmp(n_unit->tcp + 1, o_unit->tcp + 1,
+               n_unit->tcp_hdrlen - sizeof(struct tcp_header))) {
+        return false;
+    }
+    if (!seg->mss) {
+        seg->mss = n_unit->payload;
+        return true;
+    }
+    return n_unit->payload <= seg->mss && !(o_unit->payload % seg->mss);
 }
 
 static int32_t virtio_net_rsc_handle_ack(VirtioNetRscChain *chain,
@@ -2228,6 +2547,11 @@ coalesce:
             return RSC_FINAL;
         }
 
+        if (chain->n->rsc_gro && !virtio_net_rsc_gro_can_merge(seg, n_unit)) {
+            chain->stat.gso_mismatch++;
+            return RSC_FINAL;
+        }
+
         /* Here comes the right data, the payload length in v4/v6 is different,
            so use the field value to update and record the new data len */
         o_unit->payload += n_unit->payload; /* update new data len */
@@ -2293,8 +2617,10 @@ static int32_t virtio_net_rsc_coalesce6(VirtioNetRscChain *chain,
 /* Packets with 'SYN' should bypass, other flag should be sent after drain
  * to prevent out of order */
 static int virtio_net_rsc_tcp_ctrl_check(VirtioNetRscChain *chain,
+                                         const uint8_t *buf,
                                          struct tcp_header *tcp)
 {
+    const struct virtio_net_hdr *h = (const struct virtio_net_hdr *)buf;
     uint16_t tcp_hdr;
     uint16_t tcp_flag;
 
@@ -2311,6 +2637,18 @@ static int virtio_net_rsc_tcp_ctrl_check(VirtioNetRscChain *chain,
         return RSC_FINAL;
     }
 
+    if (chain->n->rsc_gro) {
+        /* Only merge what the host verified, and never resegment GSO */
+        if (h->gso_type != VIRTIO_NET_HDR_GSO_NONE ||
+            !(h->flags & (VIRTIO_NET_HDR_F_NEEDS_CSUM |
+                          VIRTIO_NET_HDR_F_DATA_VALID))) {
+            chain->stat.csum_unverified++;
+            return RSC_FINAL;
+        }
+        /* Options are compared when merging */
+        return RSC_CANDIDATE;
+    }
+
     if (tcp_hdr > sizeof(struct tcp_header)) {
         chain->stat.tcp_all_opt++;
         return RSC_FINAL;
@@ -2325,7 +2663,8 @@ static size_t virtio_net_rsc_do_coalesce(VirtioNetRscChain *chain,
                                          VirtioNetRscUnit *unit)
 {
     int ret;
-    VirtioNetRscSeg *seg, *nseg;
+    VirtioNetRscSeg *seg;
+    VirtioNetRscFlow flow;
 
     if (QTAILQ_EMPTY(&chain->buffers)) {
         chain->stat.empty_cache++;
@@ -2335,33 +2674,35 @@ static size_t virtio_net_rsc_do_coalesce(VirtioNetRscChain *chain,
         return size;
     }
 
-    QTAILQ_FOREACH_SAFE(seg, &chain->buffers, next, nseg) {
-        if (chain->proto == ETH_P_IP) {
-            ret = virtio_net_rsc_coalesce4(chain, seg, buf, size, unit);
-        } else {
-            ret = virtio_net_rsc_coalesce6(chain, seg, buf, size, unit);
-        }
+    /* At most one segment is cached per flow */
+    virtio_net_rsc_unit_flow(chain, unit, &flow);
+    seg = g_hash_table_lookup(chain->flows, &flow);
+    if (!seg) {
+        chain->stat.no_match_cache++;
+        virtio_net_rsc_cache_buf(chain, nc, buf, size);
+        return size;
+    }
 
-        if (ret == RSC_FINAL) {
-            if (virtio_net_rsc_drain_seg(chain, seg) == 0) {
-                /* Send failed */
-                chain->stat.final_failed++;
-                return 0;
-            }
+    if (chain->proto == ETH_P_IP) {
+        ret = virtio_net_rsc_coalesce4(chain, seg, buf, size, unit);
+    } else {
+        ret = virtio_net_rsc_coalesce6(chain, seg, buf, size, unit);
+    }
 
-            /* Send current packet */
-            return virtio_net_do_receive(nc, buf, size);
-        } else if (ret == RSC_NO_MATCH) {
-            continue;
-        } else {
-            /* Coalesced, mark coalesced flag to tell calc cksum for ipv4 */
-            seg->is_coalesced = 1;
-            return size;
+    if (ret == RSC_FINAL) {
+        if (virtio_net_rsc_drain_seg(chain, seg) == 0) {
+            /* Send failed */
+            chain->stat.final_failed++;
+            return 0;
         }
+
+        /* Send current packet */
+        return virtio_net_do_receive(nc, buf, size);
     }
 
-    chain->stat.no_match_cache++;
-    virtio_net_rsc_cache_buf(chain, nc, buf, size);
+    assert(ret != RSC_NO_MATCH);
+    /* Coalesced, mark coalesced flag to tell calc cksum for ipv4 */
+    seg->is_coalesced = 1;
     return size;
 }
 
@@ -2372,21 +2713,13 @@ static size_t virtio_net_rsc_drain_flow(VirtioNetRscChain *chain,
                                         uint16_t ip_start, uint16_t ip_size,
                                         uint16_t tcp_port)
 {
-    VirtioNetRscSeg *seg, *nseg;
-    uint32_t ppair1, ppair2;
-
-    ppair1 = *(uint32_t *)(buf + tcp_port);
-    QTAILQ_FOREACH_SAFE(seg, &chain->buffers, next, nseg) {
-        ppair2 = *(uint32_t *)(seg->buf + tcp_port);
-        if (memcmp(buf + ip_start, seg->buf + ip_start, ip_size)
-            || (ppair1 != ppair2)) {
-            continue;
-        }
-        if (virtio_net_rsc_drain_seg(chain, seg) == 0) {
-            chain->stat.drain_failed++;
-        }
+    VirtioNetRscSeg *seg;
+    VirtioNetRscFlow flow;
 
-        break;
+    virtio_net_rsc_flow_init(&flow, buf + ip_start, ip_size, buf + tcp_port);
+    seg = g_hash_table_lookup(chain->flows, &flow);
+    if (seg && virtio_net_rsc_drain_seg(chain, seg) == 0) {
+        chain->stat.drain_failed++;
     }
 
     return virtio_net_do_receive(nc, buf, size);
@@ -2460,7 +2793,7 @@ static size_t virtio_net_rsc_receive4(VirtioNetRscChain *chain,
         return virtio_net_do_receive(nc, buf, size);
     }
 
-    ret = virtio_net_rsc_tcp_ctrl_check(chain, unit.tcp);
+    ret = virtio_net_rsc_tcp_ctrl_check(chain, buf, unit.tcp);
     if (ret == RSC_BYPASS) {
         return virtio_net_do_receive(nc, buf, size);
     } else if (ret == RSC_FINAL) {
@@ -2529,7 +2862,7 @@ static size_t virtio_net_rsc_receive6(void *opq, NetClientState *nc,
         return virtio_net_do_receive(nc, buf, size);
     }
 
-    ret = virtio_net_rsc_tcp_ctrl_check(chain, unit.tcp);
+    ret = virtio_net_rsc_tcp_ctrl_check(chain, buf, unit.tcp);
     if (ret == RSC_BYPASS) {
         return virtio_net_do_receive(nc, buf, size);
     } else if (ret == RSC_FINAL) {
@@ -2574,6 +2907,8 @@ static VirtioNetRscChain *virtio_net_rsc_lookup_chain(VirtIONet *n,
     memset(&chain->stat, 0, sizeof(chain->stat));
 
     QTAILQ_INIT(&chain->buffers);
+    chain->flows = g_hash_table_new(virtio_net_rsc_flow_hash,
+                                    virtio_net_rsc_flow_equal);
     QTAILQ_INSERT_TAIL(&n->rsc_chains, chain, next);
 
     return chain;
@@ -2612,7 +2947,9 @@ static ssize_t virtio_net_receive(NetClientState *nc, const uint8_t *buf,
                                   size_t size)
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
-    if ((n->rsc4_enabled || n->rsc6_enabled)) {
+    /* GRO frames are built in place, which needs the guest header layout */
+    if ((n->rsc4_enabled || n->rsc6_enabled) &&
+        (!n->rsc_gro || n->host_hdr_len == n->guest_hdr_len)) {
         return virtio_net_rsc_receive(nc, buf, size);
     } else {
         return virtio_net_do_receive(nc, buf, size);
@@ -2629,7 +2966,7 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
     int ret;
 
     virtqueue_push(q->tx_vq, q->async_tx.elem, 0);
-    virtio_notify(vdev, q->tx_vq);
+    virtio_net_notify(q, q->tx_vq);
 
     g_free(q->async_tx.elem);
     q->async_tx.elem = NULL;
@@ -2654,6 +2991,20 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
 }
 
 /* TX */
+/*
+ * Publish the @count elements virtio_net_flush_tx() has filled into the used
+ * ring so far, with a single used index update and guest notification.
+ */
+static void virtio_net_tx_flush_used(VirtIONetQueue *q, unsigned int count)
+{
+    if (count) {
+        RCU_READ_LOCK_GUARD();
+
+        virtqueue_flush(q->tx_vq, count);
+        virtio_net_notify(q, q->tx_vq);
+    }
+}
+
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
 {
     VirtIONet *n = q->n;
@@ -2684,6 +3035,7 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
         out_num = elem->out_num;
         out_sg = elem->out_sg;
         if (out_num < 1) {
+            virtio_net_tx_flush_used(q, num_packets);
             virtio_error(vdev, "virtio-net header not in first element");
             virtqueue_detach_element(q->tx_vq, elem, 0);
             g_free(elem);
@@ -2693,6 +3045,7 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
         if (n->has_vnet_hdr) {
             if (iov_to_buf(out_sg, out_num, 0, &mhdr, n->guest_hdr_len) <
                 n->guest_hdr_len) {
+                virtio_net_tx_flush_used(q, num_packets);
                 virtio_error(vdev, "virtio-net header incorrect");
                 virtqueue_detach_element(q->tx_vq, elem, 0);
                 g_free(elem);
@@ -2732,20 +3085,24 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
         ret = qemu_sendv_packet_async(qemu_get_subqueue(n->nic, queue_index),
                                       out_sg, out_num, virtio_net_tx_complete);
         if (ret == 0) {
+            virtio_net_tx_flush_used(q, num_packets);
             virtio_queue_set_notification(q->tx_vq, 0);
             q->async_tx.elem = elem;
             return -EBUSY;
         }
 
 drop:
-        virtqueue_push(q->tx_vq, elem, 0);
-        virtio_notify(vdev, q->tx_vq);
+        /* Completions are published in one go once the burst is over */
+        WITH_RCU_READ_LOCK_GUARD() {
+            virtqueue_fill(q->tx_vq, elem, 0, num_packets);
+        }
         g_free(elem);
 
         if (++num_packets >= n->tx_burst) {
             break;
         }
     }
+    virtio_net_tx_flush_used(q, num_packets);
     return num_packets;
 }
 
@@ -2757,7 +3114,7 @@ static void virtio_net_handle_tx_timer(VirtIODevice *vdev, VirtQueue *vq)
     VirtIONetQueue *q = &n->vqs[vq2q(virtio_get_queue_index(vq))];
 
     if (unlikely((n->status & VIRTIO_NET_S_LINK_UP) == 0)) {
-        virtio_net_drop_tx_queue_data(vdev, vq);
+        virtio_net_drop_tx_queue_data(q);
         return;
     }
 
@@ -2784,22 +3141,25 @@ static void virtio_net_handle_tx_bh(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
     VirtIONetQueue *q = &n->vqs[vq2q(virtio_get_queue_index(vq))];
+    AioContext *ctx = virtio_net_queue_acquire(q);
 
     if (unlikely((n->status & VIRTIO_NET_S_LINK_UP) == 0)) {
-        virtio_net_drop_tx_queue_data(vdev, vq);
-        return;
+        virtio_net_drop_tx_queue_data(q);
+        goto out;
     }
 
     if (unlikely(q->tx_waiting)) {
-        return;
+        goto out;
     }
     q->tx_waiting = 1;
     /* This happens when device was stopped but VCPU wasn't. */
     if (!vdev->vm_running) {
-        return;
+        goto out;
     }
     virtio_queue_set_notification(vq, 0);
     qemu_bh_schedule(q->tx_bh);
+out:
+    virtio_net_queue_release(ctx);
 }
 
 static void virtio_net_tx_timer(void *opaque)
@@ -2852,9 +3212,8 @@ static void virtio_net_tx_timer(void *opaque)
     }
 }
 
-static void virtio_net_tx_bh(void *opaque)
+static void virtio_net_tx_bh_locked(VirtIONetQueue *q)
 {
-    VirtIONetQueue *q = opaque;
     VirtIONet *n = q->n;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
     int32_t ret;
@@ -2901,6 +3260,15 @@ static void virtio_net_tx_bh(void *opaque)
     }
 }
 
+static void virtio_net_tx_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    AioContext *ctx = virtio_net_queue_acquire(q);
+
+    virtio_net_tx_bh_locked(q);
+    virtio_net_queue_release(ctx);
+}
+
 static void virtio_net_add_queue(VirtIONet *n, int index)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
@@ -2947,6 +3315,172 @@ static void virtio_net_del_queue(VirtIONet *n, int index)
     virtio_del_queue(vdev, index * 2 + 1);
 }
 
+static int virtio_net_dataplane_queue_pairs(VirtIONet *n)
+{
+    return n->multiqueue ? n->max_queue_pairs : 1;
+}
+
+/*
+ * Move each queue pair and its backend to an IOThread.  The control
+ * virtqueue stays in the main loop.
+ */
+static void virtio_net_dataplane_start(VirtIONet *n)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int queue_pairs = virtio_net_dataplane_queue_pairs(n);
+    int i, r;
+
+    for (i = 0; i < queue_pairs; i++) {
+        if (!qemu_can_set_aio_context(qemu_get_subqueue(n->nic, i))) {
+            warn_report_once("virtio-net: netdev cannot run in an IOThread, "
+                             "using the main loop");
+            return;
+        }
+    }
+
+    if (!k->set_guest_notifiers) {
+        warn_report_once("virtio-net: transport does not support guest "
+                         "notifiers, using the main loop");
+        return;
+    }
+
+    /*
+     * Guest notifier masking is implemented by vhost only, let the
+     * transport handle masked vectors itself while the IOThreads run.
+     */
+    n->dataplane_saved_notifier_mask = vdev->use_guest_notifier_mask;
+    vdev->use_guest_notifier_mask = false;
+    r = k->set_guest_notifiers(qbus->parent, queue_pairs * 2, true);
+    if (r < 0) {
+        vdev->use_guest_notifier_mask = n->dataplane_saved_notifier_mask;
+        warn_report_once("virtio-net: failed to set guest notifier (%d), "
+                         "using the main loop", r);
+        return;
+    }
+
+    for (i = 0; i < queue_pairs; i++) {
+        VirtIONetQueue *q = &n->vqs[i];
+        IOThread *iothread = n->iothreads[i % n->num_iothreads];
+        AioContext *ctx = iothread_get_aio_context(iothread);
+
+        event_notifier_set_handler(virtio_queue_get_host_notifier(q->rx_vq),
+                                   NULL);
+        event_notifier_set_handler(virtio_queue_get_host_notifier(q->tx_vq),
+                                   NULL);
+        qemu_bh_delete(q->tx_bh);
+        q->tx_bh = aio_bh_new_guarded(ctx, virtio_net_tx_bh, q,
+                                      &DEVICE(vdev)->mem_reentrancy_guard);
+
+        aio_context_acquire(ctx);
+        q->ctx = ctx;
+        qemu_set_aio_context(qemu_get_subqueue(n->nic, i), ctx);
+        /* RX kicks only refill buffers, polling is for TX */
+        virtio_queue_aio_attach_host_notifier_no_poll(q->rx_vq, ctx);
+        virtio_queue_aio_attach_host_notifier(q->tx_vq, ctx);
+        if (q->tx_waiting) {
+            qemu_bh_schedule(q->tx_bh);
+        }
+        aio_context_release(ctx);
+
+        /* Kick right away to process buffers already in the vrings */
+        event_notifier_set(virtio_queue_get_host_notifier(q->rx_vq));
+        event_notifier_set(virtio_queue_get_host_notifier(q->tx_vq));
+    }
+    n->dataplane_started = true;
+}
+
+static void virtio_net_dataplane_stop_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    VirtIONet *n = q->n;
+    AioContext *ctx = q->ctx;
+
+    aio_context_acquire(ctx);
+    virtio_queue_aio_detach_host_notifier(q->rx_vq, ctx);
+    virtio_queue_aio_detach_host_notifier(q->tx_vq, ctx);
+    qemu_bh_cancel(q->tx_bh);
+    qemu_set_aio_context(qemu_get_subqueue(n->nic, q - n->vqs), NULL);
+    aio_context_release(ctx);
+}
+
+static void virtio_net_dataplane_stop(VirtIONet *n)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int queue_pairs = virtio_net_dataplane_queue_pairs(n);
+    int i;
+
+    for (i = 0; i < queue_pairs; i++) {
+        VirtIONetQueue *q = &n->vqs[i];
+
+        aio_wait_bh_oneshot(q->ctx, virtio_net_dataplane_stop_bh, q);
+
+        q->ctx = NULL;
+        qemu_bh_delete(q->tx_bh);
+        q->tx_bh = qemu_bh_new_guarded(virtio_net_tx_bh, q,
+                                       &DEVICE(vdev)->mem_reentrancy_guard);
+        if (q->tx_waiting) {
+            qemu_bh_schedule(q->tx_bh);
+        }
+
+        event_notifier_set_handler(virtio_queue_get_host_notifier(q->rx_vq),
+                                   virtio_queue_host_notifier_read);
+        event_notifier_set_handler(virtio_queue_get_host_notifier(q->tx_vq),
+                                   virtio_queue_host_notifier_read);
+        event_notifier_set(virtio_queue_get_host_notifier(q->rx_vq));
+        event_notifier_set(virtio_queue_get_host_notifier(q->tx_vq));
+    }
+
+    k->set_guest_notifiers(qbus->parent, queue_pairs * 2, false);
+    vdev->use_guest_notifier_mask = n->dataplane_saved_notifier_mask;
+    n->dataplane_started = false;
+}
+
+/*
+ * Run the queue pairs in IOThreads whenever the device is processed by
+ * QEMU itself with ioeventfd.  Receive segment coalescing and software RSS
+ * share state across queue pairs and keep everything in the main loop.
+ */
+static void virtio_net_dataplane_update(VirtIONet *n, uint8_t status)
+{
+    bool run = n->num_iothreads && n->ioeventfd_started &&
+               !n->dataplane_blocked && !n->vhost_started &&
+               virtio_net_started(n, status) &&
+               !n->rsc4_enabled && !n->rsc6_enabled &&
+               !(n->rss_data.enabled && n->rss_data.enabled_software_rss);
+
+    if (run && !n->dataplane_started) {
+        virtio_net_dataplane_start(n);
+    } else if (!run && n->dataplane_started) {
+        virtio_net_dataplane_stop(n);
+    }
+}
+
+static int virtio_net_start_ioeventfd(VirtIODevice *vdev)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    int r;
+
+    r = virtio_device_start_ioeventfd_impl(vdev);
+    if (r == 0) {
+        n->ioeventfd_started = true;
+        virtio_net_dataplane_update(n, vdev->status);
+    }
+    return r;
+}
+
+static void virtio_net_stop_ioeventfd(VirtIODevice *vdev)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+
+    n->ioeventfd_started = false;
+    virtio_net_dataplane_update(n, vdev->status);
+    virtio_device_stop_ioeventfd_impl(vdev);
+}
+
 static void virtio_net_change_num_queue_pairs(VirtIONet *n, int new_max_queue_pairs)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
@@ -3336,6 +3870,8 @@ static NetClientInfo net_virtio_info = {
     .size = sizeof(NICState),
     .can_receive = virtio_net_can_receive,
     .receive = virtio_net_receive,
+    .receive_batch_begin = virtio_net_receive_batch_begin,
+    .receive_batch_end = virtio_net_receive_batch_end,
     .link_status_changed = virtio_net_set_link_status,
     .query_rx_filter = virtio_net_query_rxfilter,
     .announce = virtio_net_announce,
@@ -3568,6 +4104,20 @@ static bool failover_hide_primary_device(DeviceListener *listener,
     return qatomic_read(&n->failover_primary_hidden);
 }
 
+static void virtio_net_put_iothreads(VirtIONet *n)
+{
+    int i;
+
+    for (i = 0; i < n->num_iothreads; i++) {
+        if (n->iothreads[i]) {
+            object_unref(OBJECT(n->iothreads[i]));
+        }
+    }
+    g_free(n->iothreads);
+    n->iothreads = NULL;
+    n->num_iothreads = 0;
+}
+
 static void virtio_net_device_realize(DeviceState *dev, Error **errp)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(dev);
@@ -3662,6 +4212,34 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
         virtio_cleanup(vdev);
         return;
     }
+
+    if (n->iothread_ids) {
+        strList *id;
+        int len = 0;
+
+        if (n->net_conf.tx && !strcmp(n->net_conf.tx, "timer")) {
+            error_setg(errp, "'iothreads' is incompatible with tx=timer");
+            virtio_cleanup(vdev);
+            return;
+        }
+        for (id = n->iothread_ids; id; id = id->next) {
+            len++;
+        }
+        n->iothreads = g_new0(IOThread *, len);
+        for (id = n->iothread_ids; id; id = id->next) {
+            IOThread *iothread = iothread_by_id(id->value);
+
+            if (!iothread) {
+                error_setg(errp, "IOThread '%s' not found", id->value);
+                virtio_net_put_iothreads(n);
+                virtio_cleanup(vdev);
+                return;
+            }
+            object_ref(OBJECT(iothread));
+            n->iothreads[n->num_iothreads++] = iothread;
+        }
+    }
+
     n->vqs = g_new0(VirtIONetQueue, n->max_queue_pairs);
     n->curr_queue_pairs = 1;
     n->tx_timeout = n->net_conf.txtimer;
@@ -3786,6 +4364,7 @@ static void virtio_net_device_unrealize(DeviceState *dev)
     virtio_net_rsc_cleanup(n);
     g_free(n->rss_data.indirections_table);
     net_rx_pkt_uninit(n->rx_pkt);
+    virtio_net_put_iothreads(n);
     virtio_cleanup(vdev);
 }
 
@@ -3858,6 +4437,51 @@ static const VMStateDescription vmstate_virtio_net = {
     .dev_unplug_pending = dev_unplug_pending,
 };
 
+static void virtio_net_get_iothreads(Object *obj, Visitor *v,
+                                     const char *name, void *opaque,
+                                     Error **errp)
+{
+    strList **ptr = object_field_prop_ptr(obj, opaque);
+
+    visit_type_strList(v, name, ptr, errp);
+}
+
+static void virtio_net_set_iothreads(Object *obj, Visitor *v,
+                                     const char *name, void *opaque,
+                                     Error **errp)
+{
+    strList **ptr = object_field_prop_ptr(obj, opaque);
+    strList *list;
+
+    if (!visit_type_strList(v, name, &list, errp)) {
+        return;
+    }
+
+    qapi_free_strList(*ptr);
+    *ptr = list;
+}
+
+static void virtio_net_release_iothreads(Object *obj, const char *name,
+                                         void *opaque)
+{
+    strList **ptr = object_field_prop_ptr(obj, opaque);
+
+    qapi_free_strList(*ptr);
+    *ptr = NULL;
+}
+
+/*
+ * A list rather than an array property, so that the proxy devices, which
+ * only alias static properties, forward it as well.
+ */
+static const PropertyInfo virtio_net_prop_iothreads = {
+    .name = "strList",
+    .description = "IDs of the IOThreads to run the queue pairs in",
+    .get = virtio_net_get_iothreads,
+    .set = virtio_net_set_iothreads,
+    .release = virtio_net_release_iothreads,
+};
+
 static Property virtio_net_properties[] = {
     DEFINE_PROP_BIT64("csum", VirtIONet, host_features,
                     VIRTIO_NET_F_CSUM, true),
@@ -3905,8 +4529,11 @@ static Property virtio_net_properties[] = {
                     VIRTIO_NET_F_HASH_REPORT, false),
     DEFINE_PROP_BIT64("guest_rsc_ext", VirtIONet, host_features,
                     VIRTIO_NET_F_RSC_EXT, false),
+    DEFINE_PROP_BIT64("in_order", VirtIONet, host_features,
+                    VIRTIO_F_IN_ORDER, false),
     DEFINE_PROP_UINT32("rsc_interval", VirtIONet, rsc_timeout,
                        VIRTIO_NET_RSC_DEFAULT_INTERVAL),
+    DEFINE_PROP_BOOL("rx_coalesce", VirtIONet, rx_coalesce, false),
     DEFINE_NIC_PROPERTIES(VirtIONet, nic_conf),
     DEFINE_PROP_UINT32("x-txtimer", VirtIONet, net_conf.txtimer,
                        TX_TIMER_INTERVAL),
@@ -3922,6 +4549,8 @@ static Property virtio_net_properties[] = {
     DEFINE_PROP_INT32("speed", VirtIONet, net_conf.speed, SPEED_UNKNOWN),
     DEFINE_PROP_STRING("duplex", VirtIONet, net_conf.duplex_str),
     DEFINE_PROP_BOOL("failover", VirtIONet, failover, false),
+    DEFINE_PROP("iothreads", VirtIONet, iothread_ids,
+                virtio_net_prop_iothreads, strList *),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -3944,6 +4573,8 @@ static void virtio_net_class_init(ObjectClass *klass, void *data)
     vdc->queue_reset = virtio_net_queue_reset;
     vdc->queue_enable = virtio_net_queue_enable;
     vdc->set_status = virtio_net_set_status;
+    vdc->start_ioeventfd = virtio_net_start_ioeventfd;
+    vdc->stop_ioeventfd = virtio_net_stop_ioeventfd;
     vdc->guest_notifier_mask = virtio_net_guest_notifier_mask;
     vdc->guest_notifier_pending = virtio_net_guest_notifier_pending;
     vdc->legacy_features |= (0x1 << VIRTIO_NET_F_GSO);
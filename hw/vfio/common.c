@@ -34,6 +34,7 @@
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 #include "qemu/range.h"
+#include "qemu/units.h"
 #include "sysemu/kvm.h"
 #include "sysemu/reset.h"
 #include "sysemu/runstate.h"
@@ -1061,6 +1062,153 @@ static bool vfio_get_section_iova_range(VFIOContainer *container,
     return true;
 }
 
+/*
+ * Plain RAM on type1 containers is (un)mapped when the memory transaction
+ * commits rather than section by section, see vfio_listener_commit().
+ */
+static bool vfio_listener_batched_section(VFIOContainer *container,
+                                          MemoryRegionSection *section)
+{
+    return (container->iommu_type == VFIO_TYPE1v2_IOMMU ||
+            container->iommu_type == VFIO_TYPE1_IOMMU) &&
+           memory_region_is_ram(section->mr) &&
+           !memory_region_is_ram_device(section->mr) &&
+           !memory_region_has_ram_discard_manager(section->mr);
+}
+
+static void vfio_listener_map_error(VFIOContainer *container,
+                                    MemoryRegion *mr, Error *err)
+{
+    if (memory_region_is_ram_device(mr)) {
+        error_report("failed to vfio_dma_map. pci p2p may not work");
+        error_free(err);
+        return;
+    }
+    /*
+     * On the initfn path, store the first error in the container so we
+     * can gracefully fail.  Runtime, there's not much we can do other
+     * than throw a hardware error.
+     */
+    if (!container->initialized) {
+        if (!container->error) {
+            error_propagate_prepend(&container->error, err,
+                                    "Region %s: ", memory_region_name(mr));
+        } else {
+            error_free(err);
+        }
+    } else {
+        error_report_err(err);
+        hw_error("vfio: DMA mapping failed, unable to continue");
+    }
+}
+
+static gint vfio_dma_range_cmp(gconstpointer a, gconstpointer b)
+{
+    const VFIODMARange *ra = a, *rb = b;
+
+    return ra->iova < rb->iova ? -1 : ra->iova > rb->iova;
+}
+
+/*
+ * Apply the queued unmaps. This has to happen before anything else gets
+ * mapped, which could overlap with the ranges going away.
+ */
+static void vfio_listener_flush_unmaps(VFIOContainer *container)
+{
+    GArray *unmaps = container->pending_unmaps;
+    GArray *maps = container->pending_maps;
+    VFIODMARange *u, *m;
+    hwaddr iova, size;
+    guint i, j;
+    int ret;
+
+    if (!unmaps->len) {
+        return;
+    }
+
+    /*
+     * A range that is removed and added again with the same translation
+     * keeps its mapping: there is no point in unpinning and repinning it.
+     */
+    for (i = 0; i < unmaps->len; i++) {
+        u = &g_array_index(unmaps, VFIODMARange, i);
+        for (j = 0; j < maps->len; j++) {
+            m = &g_array_index(maps, VFIODMARange, j);
+            if (!m->keep && m->iova == u->iova && m->size == u->size &&
+                m->vaddr == u->vaddr && m->readonly == u->readonly) {
+                trace_vfio_listener_keep_mapping(u->iova, u->size);
+                u->keep = m->keep = true;
+                break;
+            }
+        }
+    }
+
+    /*
+     * Unmap adjacent ranges with a single call; type1 accepts any range
+     * as long as it doesn't split a mapping.
+     */
+    g_array_sort(unmaps, vfio_dma_range_cmp);
+    for (i = 0; i < unmaps->len; i = j) {
+        u = &g_array_index(unmaps, VFIODMARange, i);
+        iova = u->iova;
+        size = u->size;
+        for (j = i + 1; j < unmaps->len; j++) {
+            VFIODMARange *next = &g_array_index(unmaps, VFIODMARange, j);
+
+            if (u->keep || next->keep || next->iova != iova + size) {
+                break;
+            }
+            size += next->size;
+        }
+        if (u->keep) {
+            continue;
+        }
+
+        trace_vfio_listener_unmap_batch(iova, size, j - i);
+        ret = vfio_dma_unmap(container, iova, size, NULL);
+        if (ret) {
+            error_report("vfio_dma_unmap(%p, 0x%"HWADDR_PRIx", "
+                         "0x%"HWADDR_PRIx") = %d (%s)",
+                         container, iova, size, ret, strerror(-ret));
+        }
+    }
+
+    for (i = 0; i < unmaps->len; i++) {
+        memory_region_unref(g_array_index(unmaps, VFIODMARange, i).mr);
+    }
+    g_array_set_size(unmaps, 0);
+}
+
+static void vfio_listener_commit(MemoryListener *listener)
+{
+    VFIOContainer *container = container_of(listener, VFIOContainer, listener);
+    GArray *maps = container->pending_maps;
+    Error *err = NULL;
+    guint i;
+    int ret;
+
+    vfio_listener_flush_unmaps(container);
+
+    for (i = 0; i < maps->len; i++) {
+        VFIODMARange *m = &g_array_index(maps, VFIODMARange, i);
+
+        if (m->keep) {
+            continue;
+        }
+        ret = vfio_dma_map(container, m->iova, m->size, m->vaddr,
+                           m->readonly);
+        if (ret) {
+            error_setg(&err, "vfio_dma_map(%p, 0x%"HWADDR_PRIx", "
+                       "0x%"HWADDR_PRIx", %p) = %d (%s)",
+                       container, m->iova, m->size, m->vaddr, ret,
+                       strerror(-ret));
+            vfio_listener_map_error(container, m->mr, err);
+            err = NULL;
+        }
+    }
+    g_array_set_size(maps, 0);
+}
+
 static void vfio_listener_region_add(MemoryListener *listener,
                                      MemoryRegionSection *section)
 {
@@ -1076,6 +1224,10 @@ static void vfio_listener_region_add(MemoryListener *listener,
         return;
     }
 
+    if (!vfio_listener_batched_section(container, section)) {
+        vfio_listener_flush_unmaps(container);
+    }
+
     if (!vfio_get_section_iova_range(container, section, &iova, &end, &llend)) {
         if (memory_region_is_ram_device(section->mr)) {
             trace_vfio_listener_region_add_no_dma_map(
@@ -1235,6 +1387,19 @@ static void vfio_listener_region_add(MemoryListener *listener,
         }
     }
 
+    if (vfio_listener_batched_section(container, section)) {
+        VFIODMARange map = {
+            .mr = section->mr,
+            .iova = iova,
+            .size = int128_get64(llsize),
+            .vaddr = vaddr,
+            .readonly = section->readonly,
+        };
+
+        g_array_append_val(container->pending_maps, map);
+        return;
+    }
+
     ret = vfio_dma_map(container, iova, int128_get64(llsize),
                        vaddr, section->readonly);
     if (ret) {
@@ -1253,27 +1418,7 @@ static void vfio_listener_region_add(MemoryListener *listener,
     return;
 
 fail:
-    if (memory_region_is_ram_device(section->mr)) {
-        error_report("failed to vfio_dma_map. pci p2p may not work");
-        return;
-    }
-    /*
-     * On the initfn path, store the first error in the container so we
-     * can gracefully fail.  Runtime, there's not much we can do other
-     * than throw a hardware error.
-     */
-    if (!container->initialized) {
-        if (!container->error) {
-            error_propagate_prepend(&container->error, err,
-                                    "Region %s: ",
-                                    memory_region_name(section->mr));
-        } else {
-            error_free(err);
-        }
-    } else {
-        error_report_err(err);
-        hw_error("vfio: DMA mapping failed, unable to continue");
-    }
+    vfio_listener_map_error(container, section->mr, err);
 }
 
 static void vfio_listener_region_del(MemoryListener *listener,
@@ -1320,6 +1465,22 @@ static void vfio_listener_region_del(MemoryListener *listener,
 
     trace_vfio_listener_region_del(iova, end);
 
+    if (vfio_listener_batched_section(container, section)) {
+        VFIODMARange unmap = {
+            .mr = section->mr,
+            .iova = iova,
+            .size = int128_get64(llsize),
+            .vaddr = memory_region_get_ram_ptr(section->mr) +
+                     section->offset_within_region +
+                     (iova - section->offset_within_address_space),
+            .readonly = section->readonly,
+        };
+
+        /* Dropping the reference is deferred as well */
+        g_array_append_val(container->pending_unmaps, unmap);
+        return;
+    }
+
     if (memory_region_is_ram_device(section->mr)) {
         hwaddr pgmask;
         VFIOHostDMAWindow *hostwin;
@@ -1679,6 +1840,23 @@ static int vfio_device_dma_logging_report(VFIODevice *vbasedev, hwaddr iova,
     return 0;
 }
 
+static int vfio_device_query_dirty_bitmap(VFIODevice *vbasedev,
+                                          VFIOBitmap *vbmap, hwaddr iova,
+                                          hwaddr size)
+{
+    int ret;
+
+    ret = vfio_device_dma_logging_report(vbasedev, iova, size, vbmap->bitmap);
+    if (ret) {
+        error_report("%s: Failed to get DMA logging report, iova: "
+                     "0x%" HWADDR_PRIx ", size: 0x%" HWADDR_PRIx
+                     ", err: %d (%s)",
+                     vbasedev->name, iova, size, ret, strerror(-ret));
+    }
+
+    return ret;
+}
+
 static int vfio_devices_query_dirty_bitmap(VFIOContainer *container,
                                            VFIOBitmap *vbmap, hwaddr iova,
                                            hwaddr size)
@@ -1689,14 +1867,8 @@ static int vfio_devices_query_dirty_bitmap(VFIOContainer *container,
 
     QLIST_FOREACH(group, &container->group_list, container_next) {
         QLIST_FOREACH(vbasedev, &group->device_list, next) {
-            ret = vfio_device_dma_logging_report(vbasedev, iova, size,
-                                                 vbmap->bitmap);
+            ret = vfio_device_query_dirty_bitmap(vbasedev, vbmap, iova, size);
             if (ret) {
-                error_report("%s: Failed to get DMA logging report, iova: "
-                             "0x%" HWADDR_PRIx ", size: 0x%" HWADDR_PRIx
-                             ", err: %d (%s)",
-                             vbasedev->name, iova, size, ret, strerror(-ret));
-
                 return ret;
             }
         }
@@ -1742,6 +1914,178 @@ static int vfio_query_dirty_bitmap(VFIOContainer *container, VFIOBitmap *vbmap,
     return ret;
 }
 
+/*
+ * With device dirty tracking, large ranges are synchronized in chunks, with
+ * one job per chunk and device. Jobs run in parallel and the caller merges
+ * each chunk into the RAM dirty bitmap as soon as it is complete, while the
+ * following chunks are still being queried.
+ *
+ * Container (type1) tracking is never chunked: VFIO_IOMMU_DIRTY_PAGES
+ * rejects ranges that bisect a DMA mapping, so it is queried as a whole.
+ */
+#define VFIO_DIRTY_SYNC_CHUNK_SIZE      (1 * GiB)
+#define VFIO_DIRTY_SYNC_MIN_SIZE        (256 * MiB)
+#define VFIO_DIRTY_SYNC_MAX_THREADS     8
+
+typedef struct VFIODirtyChunk {
+    VFIOBitmap vbmap;
+    /* Jobs yet to report into vbmap, protected by VFIODirtySync.lock */
+    int pending;
+} VFIODirtyChunk;
+
+typedef struct VFIODirtySync {
+    VFIODevice **devices;
+    int nr_devices;
+    hwaddr iova;
+    hwaddr size;
+    VFIODirtyChunk *chunks;
+    int nr_chunks;
+    int nr_jobs;
+    int next_job;
+    QemuMutex lock;
+    QemuCond cond;
+    int ret;
+} VFIODirtySync;
+
+static void *vfio_dirty_sync_thread(void *opaque)
+{
+    VFIODirtySync *sync = opaque;
+    const int per_chunk = sync->nr_devices;
+    int job;
+
+    while ((job = qatomic_fetch_inc(&sync->next_job)) < sync->nr_jobs) {
+        VFIODirtyChunk *chunk = &sync->chunks[job / per_chunk];
+        hwaddr iova = sync->iova +
+                      (hwaddr)(job / per_chunk) * VFIO_DIRTY_SYNC_CHUNK_SIZE;
+        hwaddr size = MIN(VFIO_DIRTY_SYNC_CHUNK_SIZE,
+                          sync->iova + sync->size - iova);
+        VFIOBitmap vbmap;
+        int ret;
+
+        ret = vfio_bitmap_alloc(&vbmap, size);
+        if (!ret) {
+            ret = vfio_device_query_dirty_bitmap(sync->devices[job % per_chunk],
+                                                 &vbmap, iova, size);
+        }
+
+        qemu_mutex_lock(&sync->lock);
+        if (ret) {
+            sync->ret = sync->ret ? sync->ret : ret;
+        } else {
+            bitmap_or(chunk->vbmap.bitmap, chunk->vbmap.bitmap, vbmap.bitmap,
+                      vbmap.pages);
+        }
+        if (!--chunk->pending) {
+            qemu_cond_broadcast(&sync->cond);
+        }
+        qemu_mutex_unlock(&sync->lock);
+        g_free(vbmap.bitmap);
+    }
+
+    return NULL;
+}
+
+static int vfio_container_device_num(VFIOContainer *container)
+{
+    VFIODevice *vbasedev;
+    VFIOGroup *group;
+    int nr = 0;
+
+    QLIST_FOREACH(group, &container->group_list, container_next) {
+        QLIST_FOREACH(vbasedev, &group->device_list, next) {
+            nr++;
+        }
+    }
+
+    return nr;
+}
+
+static int vfio_get_dirty_bitmap_parallel(VFIOContainer *container,
+                                          uint64_t iova, uint64_t size,
+                                          ram_addr_t ram_addr)
+{
+    VFIODirtySync sync = {
+        .iova = iova,
+        .size = size,
+        .nr_chunks = DIV_ROUND_UP(size, VFIO_DIRTY_SYNC_CHUNK_SIZE),
+    };
+    uint64_t dirty_pages = 0;
+    QemuThread *threads;
+    VFIODevice *vbasedev;
+    VFIOGroup *group;
+    int i, nr_threads, ret;
+
+    sync.nr_devices = vfio_container_device_num(container);
+    sync.devices = g_new(VFIODevice *, sync.nr_devices);
+    i = 0;
+    QLIST_FOREACH(group, &container->group_list, container_next) {
+        QLIST_FOREACH(vbasedev, &group->device_list, next) {
+            sync.devices[i++] = vbasedev;
+        }
+    }
+    sync.nr_jobs = sync.nr_chunks * sync.nr_devices;
+
+    sync.chunks = g_new0(VFIODirtyChunk, sync.nr_chunks);
+    for (i = 0; i < sync.nr_chunks; i++) {
+        hwaddr chunk_size = MIN(VFIO_DIRTY_SYNC_CHUNK_SIZE,
+                                size - (hwaddr)i * VFIO_DIRTY_SYNC_CHUNK_SIZE);
+
+        ret = vfio_bitmap_alloc(&sync.chunks[i].vbmap, chunk_size);
+        if (ret) {
+            goto out;
+        }
+        sync.chunks[i].pending = sync.nr_devices;
+    }
+
+    qemu_mutex_init(&sync.lock);
+    qemu_cond_init(&sync.cond);
+    nr_threads = MIN(sync.nr_jobs, VFIO_DIRTY_SYNC_MAX_THREADS);
+    threads = g_new(QemuThread, nr_threads);
+    for (i = 0; i < nr_threads; i++) {
+        qemu_thread_create(&threads[i], "vfio-dirty-sync",
+                           vfio_dirty_sync_thread, &sync,
+                           QEMU_THREAD_JOINABLE);
+    }
+
+    for (i = 0; i < sync.nr_chunks; i++) {
+        VFIODirtyChunk *chunk = &sync.chunks[i];
+
+        qemu_mutex_lock(&sync.lock);
+        while (chunk->pending) {
+            qemu_cond_wait(&sync.cond, &sync.lock);
+        }
+        ret = sync.ret;
+        qemu_mutex_unlock(&sync.lock);
+
+        if (!ret) {
+            dirty_pages += cpu_physical_memory_set_dirty_lebitmap(
+                chunk->vbmap.bitmap,
+                ram_addr + (ram_addr_t)i * VFIO_DIRTY_SYNC_CHUNK_SIZE,
+                chunk->vbmap.pages);
+        }
+    }
+
+    for (i = 0; i < nr_threads; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+    g_free(threads);
+    qemu_cond_destroy(&sync.cond);
+    qemu_mutex_destroy(&sync.lock);
+    ret = sync.ret;
+
+    trace_vfio_get_dirty_bitmap_parallel(container->fd, iova, size,
+                                         sync.nr_jobs, nr_threads, ram_addr,
+                                         dirty_pages);
+out:
+    for (i = 0; i < sync.nr_chunks; i++) {
+        g_free(sync.chunks[i].vbmap.bitmap);
+    }
+    g_free(sync.chunks);
+    g_free(sync.devices);
+
+    return ret;
+}
+
 static int vfio_get_dirty_bitmap(VFIOContainer *container, uint64_t iova,
                                  uint64_t size, ram_addr_t ram_addr)
 {
@@ -1758,6 +2102,12 @@ static int vfio_get_dirty_bitmap(VFIOContainer *container, uint64_t iova,
         return 0;
     }
 
+    if (all_device_dirty_tracking && size >= VFIO_DIRTY_SYNC_MIN_SIZE &&
+        (size > VFIO_DIRTY_SYNC_CHUNK_SIZE ||
+         vfio_container_device_num(container) > 1)) {
+        return vfio_get_dirty_bitmap_parallel(container, iova, size, ram_addr);
+    }
+
     ret = vfio_bitmap_alloc(&vbmap, size);
     if (ret) {
         return ret;
@@ -1936,6 +2286,7 @@ static const MemoryListener vfio_memory_listener = {
     .name = "vfio",
     .region_add = vfio_listener_region_add,
     .region_del = vfio_listener_region_del,
+    .commit = vfio_listener_commit,
     .log_global_start = vfio_listener_log_global_start,
     .log_global_stop = vfio_listener_log_global_stop,
     .log_sync = vfio_listener_log_sync,
@@ -2548,6 +2899,9 @@ static int vfio_connect_container(VFIOGroup *group, AddressSpace *as,
     container->dirty_pages_supported = false;
     container->dma_max_mappings = 0;
     QLIST_INIT(&container->giommu_list);
+    container->pending_maps = g_array_new(false, false, sizeof(VFIODMARange));
+    container->pending_unmaps = g_array_new(false, false,
+                                            sizeof(VFIODMARange));
     QLIST_INIT(&container->hostwin_list);
     QLIST_INIT(&container->vrdl_list);
 
@@ -2696,6 +3050,8 @@ enable_discards_exit:
     vfio_ram_block_discard_disable(container, false);
 
 free_container_exit:
+    g_array_free(container->pending_maps, true);
+    g_array_free(container->pending_unmaps, true);
     g_free(container);
 
 close_fd_exit:
@@ -2750,6 +3106,8 @@ static void vfio_disconnect_container(VFIOGroup *group)
 
         trace_vfio_disconnect_container(container->fd);
         close(container->fd);
+        g_array_free(container->pending_maps, true);
+        g_array_free(container->pending_unmaps, true);
         g_free(container);
 
         vfio_put_address_space(space);
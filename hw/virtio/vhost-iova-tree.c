@@ -13,6 +13,9 @@
 
 #define iova_min_addr qemu_real_host_page_size()
 
+/* Number of recently found mappings tried before searching the tree */
+#define VHOST_IOVA_TREE_CACHE_SIZE 4
+
 /**
  * VhostIOVATree, able to:
  * - Translate iova address
@@ -28,6 +31,9 @@ struct VhostIOVATree {
 
     /* IOVA address to qemu memory maps. */
     IOVATree *iova_taddr_map;
+
+    /* Maps of iova_taddr_map found recently, most recent first */
+    const DMAMap *cache[VHOST_IOVA_TREE_CACHE_SIZE];
 };
 
 /**
@@ -37,7 +43,7 @@ struct VhostIOVATree {
  */
 VhostIOVATree *vhost_iova_tree_new(hwaddr iova_first, hwaddr iova_last)
 {
-    VhostIOVATree *tree = g_new(VhostIOVATree, 1);
+    VhostIOVATree *tree = g_new0(VhostIOVATree, 1);
 
     /* Some devices do not like 0 addresses */
     tree->iova_first = MAX(iova_first, iova_min_addr);
@@ -70,6 +76,53 @@ const DMAMap *vhost_iova_tree_find_iova(const VhostIOVATree *tree,
     return iova_tree_find_iova(tree->iova_taddr_map, map);
 }
 
+static bool vhost_iova_tree_map_contains(const DMAMap *map,
+                                         const DMAMap *needle)
+{
+    return map->translated_addr <= needle->translated_addr &&
+           needle->translated_addr - map->translated_addr + needle->size <=
+           map->size;
+}
+
+/**
+ * Find the IOVA address stored from a memory address, trying the recently
+ * found mappings first
+ *
+ * @tree: The iova tree
+ * @map: The map with the memory address
+ *
+ * Unlike vhost_iova_tree_find_iova, a recently found mapping is only returned
+ * if it contains the whole range of @map.  Use it to translate guest buffers
+ * in the datapath, where most lookups hit the same few mappings of guest
+ * memory.
+ *
+ * Return the stored mapping, or NULL if not found.
+ */
+const DMAMap *vhost_iova_tree_find_iova_cached(VhostIOVATree *tree,
+                                               const DMAMap *map)
+{
+    const DMAMap *result;
+    int i;
+
+    for (i = 0; i < VHOST_IOVA_TREE_CACHE_SIZE && tree->cache[i]; i++) {
+        result = tree->cache[i];
+        if (vhost_iova_tree_map_contains(result, map)) {
+            goto hit;
+        }
+    }
+
+    result = iova_tree_find_iova(tree->iova_taddr_map, map);
+    if (!result) {
+        return NULL;
+    }
+    i = VHOST_IOVA_TREE_CACHE_SIZE - 1;
+
+hit:
+    memmove(&tree->cache[1], &tree->cache[0], i * sizeof(tree->cache[0]));
+    tree->cache[0] = result;
+    return result;
+}
+
 /**
  * Allocate a new mapping
  *
@@ -106,5 +159,7 @@ int vhost_iova_tree_map_alloc(VhostIOVATree *tree, DMAMap *map)
  */
 void vhost_iova_tree_remove(VhostIOVATree *iova_tree, DMAMap map)
 {
+    /* The removed maps are freed, don't keep pointers to them */
+    memset(iova_tree->cache, 0, sizeof(iova_tree->cache));
     iova_tree_remove(iova_tree->iova_taddr_map, map);
 }
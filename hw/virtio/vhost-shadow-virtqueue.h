@@ -90,6 +90,9 @@ typedef struct VhostShadowVirtqueue {
      */
     uint16_t *desc_next;
 
+    /* Translated addresses of the element being added, vring.num long */
+    hwaddr *sg_addrs;
+
     /* Caller callbacks */
     const VhostShadowVirtqueueOps *ops;
 
@@ -376,7 +376,13 @@ static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
                 continue;
             }
 
-            ram_block_discard_range(rb, ram_offset, size);
+            if (!ram_block_discard_range(rb, ram_offset, size)) {
+                /*
+                 * The discarded range now reads as zero, let a running
+                 * migration know so that the destination follows suit.
+                 */
+                qemu_guest_free_page_report(addr, size);
+            }
         }
 
 skip_element:
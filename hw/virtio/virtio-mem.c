@@ -491,9 +491,13 @@ static int virtio_mem_set_block_state(VirtIOMEM *vmem, uint64_t start_gpa,
         if (vmem->prealloc) {
             void *area = memory_region_get_ram_ptr(&vmem->memdev->mr) + offset;
             int fd = memory_region_get_fd(&vmem->memdev->mr);
+            const QemuPreallocOptions opts = {
+                .max_threads = 1,
+                .collapse = vmem->memdev->thp_collapse,
+            };
             Error *local_err = NULL;
 
-            qemu_prealloc_mem(fd, area, size, 1, NULL, &local_err);
+            qemu_prealloc_mem(fd, area, size, &opts, &local_err);
             if (local_err) {
                 static bool warned;
 
@@ -990,9 +994,13 @@ static int virtio_mem_prealloc_range_cb(const VirtIOMEM *vmem, void *arg,
 {
     void *area = memory_region_get_ram_ptr(&vmem->memdev->mr) + offset;
     int fd = memory_region_get_fd(&vmem->memdev->mr);
+    const QemuPreallocOptions opts = {
+        .max_threads = 1,
+        .collapse = vmem->memdev->thp_collapse,
+    };
     Error *local_err = NULL;
 
-    qemu_prealloc_mem(fd, area, size, 1, NULL, &local_err);
+    qemu_prealloc_mem(fd, area, size, &opts, &local_err);
     if (local_err) {
         error_report_err(local_err);
         return -ENOMEM;
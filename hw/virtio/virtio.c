@@ -16,9 +16,11 @@
 #include "qapi/qapi-commands-virtio.h"
 #include "trace.h"
 #include "qemu/error-report.h"
+#include "qemu/iov.h"
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "qemu/timer.h"
 #include "qom/object_interfaces.h"
 #include "hw/core/cpu.h"
 #include "hw/virtio/virtio.h"
@@ -30,6 +32,7 @@
 #include "hw/virtio/virtio-access.h"
 #include "sysemu/dma.h"
 #include "sysemu/runstate.h"
+#include "sysemu/xen.h"
 #include "virtio-qmp.h"
 
 #include "standard-headers/linux/virtio_ids.h"
@@ -112,6 +115,69 @@ typedef struct VRing
     VRingMemoryRegionCaches *caches;
 } VRing;
 
+/*
+ * Per-virtqueue cache of guest-physical to host mappings, used by
+ * virtqueue_dma_map().  It is direct mapped on the guest address divided
+ * by the window size; each entry caches one RAM mapping that starts at or
+ * after the beginning of its window.
+ */
+#define VIRTIO_DMA_CACHE_BITS 5
+#define VIRTIO_DMA_CACHE_SIZE (1 << VIRTIO_DMA_CACHE_BITS)
+#define VIRTIO_DMA_CACHE_WINDOW_BITS 21
+#define VIRTIO_DMA_CACHE_WINDOW (1ULL << VIRTIO_DMA_CACHE_WINDOW_BITS)
+
+typedef struct VirtIODMACacheEntry {
+    hwaddr addr;
+    hwaddr len;         /* 0 if the entry is unused */
+    uint8_t *ptr;
+    MemoryRegion *mr;
+    bool writable;
+} VirtIODMACacheEntry;
+
+typedef struct VirtIODMACache {
+    struct rcu_head rcu;
+    VirtIODMACacheEntry entry[VIRTIO_DMA_CACHE_SIZE];
+} VirtIODMACache;
+
+/* An IOMMU region in the DMA address space of a VirtIODevice */
+struct VirtIODMAIOMMU {
+    VirtIODevice *vdev;
+    MemoryRegion *mr;
+    hwaddr start;
+    IOMMUNotifier n;
+    bool registered;
+    QLIST_ENTRY(VirtIODMAIOMMU) next;
+};
+
+/*
+ * Adaptive polling of host notifiers.  Each virtqueue keeps its own polling
+ * budget within the AioContext's poll-max-ns: it starts at
+ * VIRTIO_QUEUE_POLL_START_NS once the guest kicks often enough, doubles when
+ * polling finds work in the second half of the budget and halves when the
+ * budget runs out.  Guest notifications are only suppressed while the queue
+ * is actually being polled.
+ */
+#define VIRTIO_QUEUE_POLL_START_NS  4000
+#define VIRTIO_QUEUE_POLL_MAX_NS    (256 * VIRTIO_QUEUE_POLL_START_NS)
+
+typedef struct VirtQueuePoll {
+    int64_t poll_ns;        /* current budget, 0 to wait for kicks */
+    int64_t start_ns;       /* start of the current polling period */
+    int64_t last_kick_ns;
+    bool active;            /* notifications suppressed by us */
+    uint64_t kicks;
+    uint64_t hits;
+    uint64_t misses;
+} VirtQueuePoll;
+
+/* A buffer of a packed virtqueue that waits for virtqueue_flush() */
+typedef struct VirtQueueUsedElem {
+    unsigned int index;
+    unsigned int len;
+    unsigned int ndescs;
+    bool complete;          /* len covers the whole writable buffer */
+} VirtQueueUsedElem;
+
 typedef struct VRingPackedDescEvent {
     uint16_t off_wrap;
     uint16_t flags;
@@ -120,7 +186,7 @@ typedef struct VRingPackedDescEvent {
 struct VirtQueue
 {
     VRing vring;
-    VirtQueueElement *used_elems;
+    VirtQueueUsedElem *used_elems;
 
     /* Next head to pop */
     uint16_t last_avail_idx;
@@ -153,6 +219,12 @@ struct VirtQueue
     EventNotifier host_notifier;
     bool host_notifier_enabled;
     QLIST_ENTRY(VirtQueue) node;
+
+    /* Only used by the thread that pops from the queue, RCU-protected */
+    VirtIODMACache *dma_cache;
+
+    /* Only used by the AioContext the host notifier is attached to */
+    VirtQueuePoll poll;
 };
 
 const char *virtio_device_names[] = {
@@ -215,6 +287,28 @@ static void virtio_free_region_cache(VRingMemoryRegionCaches *caches)
     g_free(caches);
 }
 
+static void virtio_virtqueue_reset_dma_cache(VirtQueue *vq)
+{
+    VirtIODMACache *cache;
+
+    if (!qatomic_read(&vq->dma_cache)) {
+        return;
+    }
+    cache = qatomic_xchg(&vq->dma_cache, NULL);
+    if (cache) {
+        g_free_rcu(cache, rcu);
+    }
+}
+
+static void virtio_reset_dma_cache(VirtIODevice *vdev)
+{
+    int i;
+
+    for (i = 0; i < VIRTIO_QUEUE_MAX; i++) {
+        virtio_virtqueue_reset_dma_cache(&vdev->vq[i]);
+    }
+}
+
 static void virtio_virtqueue_reset_region_cache(struct VirtQueue *vq)
 {
     VRingMemoryRegionCaches *caches;
@@ -592,6 +686,22 @@ static void vring_packed_desc_read_flags(VirtIODevice *vdev,
     *flags = virtio_lduw_phys_cached(vdev, cache, off);
 }
 
+/* Read all fields of a descriptor but the flags, which are already known */
+static void vring_packed_desc_read_body(VirtIODevice *vdev,
+                                        VRingPackedDesc *desc,
+                                        MemoryRegionCache *cache,
+                                        int i)
+{
+    hwaddr off = i * sizeof(VRingPackedDesc);
+
+    /* addr, len and id are contiguous, fetch them in one go */
+    address_space_read_cached(cache, off, desc,
+                              offsetof(VRingPackedDesc, flags));
+    virtio_tswap64s(vdev, &desc->addr);
+    virtio_tswap16s(vdev, &desc->id);
+    virtio_tswap32s(vdev, &desc->len);
+}
+
 static void vring_packed_desc_read(VirtIODevice *vdev,
                                    VRingPackedDesc *desc,
                                    MemoryRegionCache *cache,
@@ -599,22 +709,23 @@ static void vring_packed_desc_read(VirtIODevice *vdev,
 {
     hwaddr off = i * sizeof(VRingPackedDesc);
 
-    vring_packed_desc_read_flags(vdev, &desc->flags, cache, i);
-
     if (strict_order) {
+        vring_packed_desc_read_flags(vdev, &desc->flags, cache, i);
         /* Make sure flags is read before the rest fields. */
         smp_rmb();
+        vring_packed_desc_read_body(vdev, desc, cache, i);
+        return;
     }
 
-    address_space_read_cached(cache, off + offsetof(VRingPackedDesc, addr),
-                              &desc->addr, sizeof(desc->addr));
-    address_space_read_cached(cache, off + offsetof(VRingPackedDesc, id),
-                              &desc->id, sizeof(desc->id));
-    address_space_read_cached(cache, off + offsetof(VRingPackedDesc, len),
-                              &desc->len, sizeof(desc->len));
+    /*
+     * Descriptors after the head of a chain and in indirect tables are
+     * complete once the head is available, so read the whole descriptor.
+     */
+    address_space_read_cached(cache, off, desc, sizeof(*desc));
     virtio_tswap64s(vdev, &desc->addr);
     virtio_tswap16s(vdev, &desc->id);
     virtio_tswap32s(vdev, &desc->len);
+    virtio_tswap16s(vdev, &desc->flags);
 }
 
 static void vring_packed_desc_write_data(VirtIODevice *vdev,
@@ -871,10 +982,15 @@ static void virtqueue_packed_fill(VirtQueue *vq, const VirtQueueElement *elem,
     vq->used_elems[idx].index = elem->index;
     vq->used_elems[idx].len = len;
     vq->used_elems[idx].ndescs = elem->ndescs;
+    vq->used_elems[idx].complete = !elem->in_num ||
+        len == iov_size(elem->in_sg, elem->in_num);
 }
 
+/*
+ * Write the used descriptor of @elem @idx descriptors after used_idx.
+ */
 static void virtqueue_packed_fill_desc(VirtQueue *vq,
-                                       const VirtQueueElement *elem,
+                                       const VirtQueueUsedElem *elem,
                                        unsigned int idx,
                                        bool strict_order)
 {
@@ -950,6 +1066,28 @@ static void virtqueue_split_flush(VirtQueue *vq, unsigned int count)
         vq->signalled_used_valid = false;
 }
 
+/*
+ * With VIRTIO_F_IN_ORDER the driver takes a used descriptor as the
+ * completion of all buffers made available before it, as if the device had
+ * written their whole writable part.  This is the case when all but the last
+ * buffer of a batch were filled completely, or have nothing to write to.
+ */
+static bool virtqueue_packed_flush_in_order(VirtQueue *vq, unsigned int count)
+{
+    unsigned int i;
+
+    if (!virtio_vdev_has_feature(vq->vdev, VIRTIO_F_IN_ORDER)) {
+        return false;
+    }
+
+    for (i = 0; i + 1 < count; i++) {
+        if (!vq->used_elems[i].complete) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static void virtqueue_packed_flush(VirtQueue *vq, unsigned int count)
 {
     unsigned int i, ndescs = 0;
@@ -958,12 +1096,21 @@ static void virtqueue_packed_flush(VirtQueue *vq, unsigned int count)
         return;
     }
 
-    for (i = 1; i < count; i++) {
-        virtqueue_packed_fill_desc(vq, &vq->used_elems[i], i, false);
-        ndescs += vq->used_elems[i].ndescs;
+    if (count > 1 && virtqueue_packed_flush_in_order(vq, count)) {
+        /* One used descriptor for the whole batch, the driver skips ahead */
+        for (i = 0; i < count; i++) {
+            ndescs += vq->used_elems[i].ndescs;
+        }
+        virtqueue_packed_fill_desc(vq, &vq->used_elems[count - 1], 0, true);
+    } else {
+        /* Each buffer takes as many slots as it had descriptors */
+        ndescs = vq->used_elems[0].ndescs;
+        for (i = 1; i < count; i++) {
+            virtqueue_packed_fill_desc(vq, &vq->used_elems[i], ndescs, false);
+            ndescs += vq->used_elems[i].ndescs;
+        }
+        virtqueue_packed_fill_desc(vq, &vq->used_elems[0], 0, true);
     }
-    virtqueue_packed_fill_desc(vq, &vq->used_elems[0], 0, true);
-    ndescs += vq->used_elems[0].ndescs;
 
     vq->inuse -= ndescs;
     vq->used_idx += ndescs;
@@ -1365,11 +1512,107 @@ int virtqueue_avail_bytes(VirtQueue *vq, unsigned int in_bytes,
     return in_bytes <= in_total && out_bytes <= out_total;
 }
 
-static bool virtqueue_map_desc(VirtIODevice *vdev, unsigned int *p_num_sg,
+/*
+ * Must be called before translating the address that is going to be
+ * inserted in the cache, so that an invalidation that races with the
+ * translation drops the new entry as well.
+ */
+static VirtIODMACache *virtqueue_get_dma_cache(VirtQueue *vq)
+{
+    VirtIODMACache *cache = qatomic_rcu_read(&vq->dma_cache);
+
+    if (!cache && qatomic_read(&vq->vdev->dma_cache_enabled)) {
+        cache = g_new0(VirtIODMACache, 1);
+        if (qatomic_cmpxchg(&vq->dma_cache, NULL, cache) != NULL) {
+            g_free(cache);
+            cache = qatomic_rcu_read(&vq->dma_cache);
+        }
+    }
+    return cache;
+}
+
+/*
+ * Like dma_memory_map(), but first look for the translation in the DMA
+ * cache of @vq.  A hit only takes the memory region reference that
+ * address_space_map() would take, so the result is released with
+ * dma_memory_unmap() in either case.
+ */
+static void *virtqueue_dma_map(VirtQueue *vq, hwaddr addr, hwaddr *plen,
+                               bool is_write)
+{
+    VirtIODevice *vdev = vq->vdev;
+    VirtIODMACache *cache;
+    VirtIODMACacheEntry *e;
+    MemoryRegion *mr;
+    ram_addr_t offset;
+    hwaddr len, wlen;
+    void *ptr, *wptr;
+
+    RCU_READ_LOCK_GUARD();
+
+    cache = virtqueue_get_dma_cache(vq);
+    if (!cache) {
+        return dma_memory_map(vdev->dma_as, addr, plen,
+                              is_write ? DMA_DIRECTION_FROM_DEVICE :
+                              DMA_DIRECTION_TO_DEVICE,
+                              MEMTXATTRS_UNSPECIFIED);
+    }
+
+    e = &cache->entry[(addr >> VIRTIO_DMA_CACHE_WINDOW_BITS) &
+                      (VIRTIO_DMA_CACHE_SIZE - 1)];
+    if (addr >= e->addr && addr - e->addr < e->len &&
+        (e->writable || !is_write)) {
+        memory_region_ref(e->mr);
+        *plen = MIN(*plen, e->len - (addr - e->addr));
+        return e->ptr + (addr - e->addr);
+    }
+
+    len = *plen;
+    ptr = address_space_map(vdev->dma_as, addr, &len, is_write,
+                            MEMTXATTRS_UNSPECIFIED);
+    if (!ptr) {
+        *plen = 0;
+        return NULL;
+    }
+    *plen = len;
+
+    /* Do not cache the bounce buffer */
+    mr = memory_region_from_host(ptr, &offset);
+    if (!mr) {
+        return ptr;
+    }
+
+    /*
+     * Without an IOMMU in the way, also look up the rest of the window, so
+     * that later buffers in the same area hit the cache.  The beginning is
+     * known to be RAM, so this cannot end up in the bounce buffer.
+     */
+    wlen = ROUND_UP(addr + 1, VIRTIO_DMA_CACHE_WINDOW) - addr;
+    if (len < wlen && qatomic_read(&vdev->dma_cache_widen)) {
+        wptr = address_space_map(vdev->dma_as, addr, &wlen, is_write,
+                                 MEMTXATTRS_UNSPECIFIED);
+        if (wptr) {
+            if (wptr == ptr) {
+                len = MAX(len, wlen);
+            }
+            address_space_unmap(vdev->dma_as, wptr, wlen, false, 0);
+        }
+    }
+
+    e->addr = addr;
+    e->len = len;
+    e->ptr = ptr;
+    e->mr = mr;
+    e->writable = is_write;
+    return ptr;
+}
+
+static bool virtqueue_map_desc(VirtQueue *vq, unsigned int *p_num_sg,
                                hwaddr *addr, struct iovec *iov,
                                unsigned int max_num_sg, bool is_write,
                                hwaddr pa, size_t sz)
 {
+    VirtIODevice *vdev = vq->vdev;
     bool ok = false;
     unsigned num_sg = *p_num_sg;
     assert(num_sg <= max_num_sg);
@@ -1388,11 +1631,7 @@ static bool virtqueue_map_desc(VirtIODevice *vdev, unsigned int *p_num_sg,
             goto out;
         }
 
-        iov[num_sg].iov_base = dma_memory_map(vdev->dma_as, pa, &len,
-                                              is_write ?
-                                              DMA_DIRECTION_FROM_DEVICE :
-                                              DMA_DIRECTION_TO_DEVICE,
-                                              MEMTXATTRS_UNSPECIFIED);
+        iov[num_sg].iov_base = virtqueue_dma_map(vq, pa, &len, is_write);
         if (!iov[num_sg].iov_base) {
             virtio_error(vdev, "virtio: bogus descriptor or out of resources");
             goto out;
@@ -1483,7 +1722,12 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     return elem;
 }
 
-static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
+/*
+ * With @set_avail_event false, the caller is responsible for publishing
+ * the avail event (if negotiated) once it has popped everything it wants.
+ */
+static void *virtqueue_split_pop(VirtQueue *vq, size_t sz,
+                                 bool set_avail_event)
 {
     unsigned int i, head, max;
     VRingMemoryRegionCaches *caches;
@@ -1520,7 +1764,8 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
         goto done;
     }
 
-    if (virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
+    if (set_avail_event &&
+        virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
         vring_set_avail_event(vq, vq->last_avail_idx);
     }
 
@@ -1564,7 +1809,7 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
         bool map_ok;
 
         if (desc.flags & VRING_DESC_F_WRITE) {
-            map_ok = virtqueue_map_desc(vdev, &in_num, addr + out_num,
+            map_ok = virtqueue_map_desc(vq, &in_num, addr + out_num,
                                         iov + out_num,
                                         VIRTQUEUE_MAX_SIZE - out_num, true,
                                         desc.addr, desc.len);
@@ -1573,7 +1818,7 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
                 virtio_error(vdev, "Incorrect order for descriptors");
                 goto err_undo_map;
             }
-            map_ok = virtqueue_map_desc(vdev, &out_num, addr, iov,
+            map_ok = virtqueue_map_desc(vq, &out_num, addr, iov,
                                         VIRTQUEUE_MAX_SIZE, false,
                                         desc.addr, desc.len);
         }
@@ -1637,7 +1882,23 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
     int rc;
 
     RCU_READ_LOCK_GUARD();
-    if (virtio_queue_packed_empty_rcu(vq)) {
+    if (unlikely(!vq->vring.desc)) {
+        goto done;
+    }
+
+    caches = vring_get_region_caches(vq);
+    if (!caches) {
+        goto done;
+    }
+
+    /*
+     * Read the flags of the head only once, both to check if the queue is
+     * empty and for the descriptor itself.
+     */
+    i = vq->last_avail_idx;
+    desc_cache = &caches->desc;
+    vring_packed_desc_read_flags(vdev, &desc.flags, desc_cache, i);
+    if (!is_desc_avail(desc.flags, vq->last_avail_wrap_counter)) {
         goto done;
     }
 
@@ -1651,21 +1912,14 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
         goto done;
     }
 
-    i = vq->last_avail_idx;
-
-    caches = vring_get_region_caches(vq);
-    if (!caches) {
-        virtio_error(vdev, "Region caches not initialized");
-        goto done;
-    }
-
     if (caches->desc.len < max * sizeof(VRingDesc)) {
         virtio_error(vdev, "Cannot map descriptor ring");
         goto done;
     }
 
-    desc_cache = &caches->desc;
-    vring_packed_desc_read(vdev, &desc, desc_cache, i, true);
+    /* Make sure flags is read before the rest fields. */
+    smp_rmb();
+    vring_packed_desc_read_body(vdev, &desc, desc_cache, i);
     id = desc.id;
     if (desc.flags & VRING_DESC_F_INDIRECT) {
         if (desc.len % sizeof(VRingPackedDesc)) {
@@ -1692,7 +1946,7 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
         bool map_ok;
 
         if (desc.flags & VRING_DESC_F_WRITE) {
-            map_ok = virtqueue_map_desc(vdev, &in_num, addr + out_num,
+            map_ok = virtqueue_map_desc(vq, &in_num, addr + out_num,
                                         iov + out_num,
                                         VIRTQUEUE_MAX_SIZE - out_num, true,
                                         desc.addr, desc.len);
@@ -1701,7 +1955,7 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
                 virtio_error(vdev, "Incorrect order for descriptors");
                 goto err_undo_map;
             }
-            map_ok = virtqueue_map_desc(vdev, &out_num, addr, iov,
+            map_ok = virtqueue_map_desc(vq, &out_num, addr, iov,
                                         VIRTQUEUE_MAX_SIZE, false,
                                         desc.addr, desc.len);
         }
@@ -1764,10 +2018,40 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
     if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
         return virtqueue_packed_pop(vq, sz);
     } else {
-        return virtqueue_split_pop(vq, sz);
+        return virtqueue_split_pop(vq, sz, true);
     }
 }
 
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max)
+{
+    unsigned int n = 0;
+
+    if (virtio_device_disabled(vq->vdev)) {
+        return 0;
+    }
+
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
+        while (n < max && (elems[n] = virtqueue_packed_pop(vq, sz))) {
+            n++;
+        }
+        return n;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    while (n < max && (elems[n] = virtqueue_split_pop(vq, sz, false))) {
+        n++;
+    }
+    /*
+     * The guest only needs to see the avail event move once per batch,
+     * which saves a store to guest memory for every element but the last.
+     */
+    if (n && virtio_vdev_has_feature(vq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+    return n;
+}
+
 static unsigned int virtqueue_packed_drop_all(VirtQueue *vq)
 {
     VRingMemoryRegionCaches *caches;
@@ -2071,6 +2355,7 @@ static void __virtio_queue_reset(VirtIODevice *vdev, uint32_t i)
     vdev->vq[i].notification = true;
     vdev->vq[i].vring.num = vdev->vq[i].vring.num_default;
     vdev->vq[i].inuse = 0;
+    memset(&vdev->vq[i].poll, 0, sizeof(vdev->vq[i].poll));
     virtio_virtqueue_reset_region_cache(&vdev->vq[i]);
 }
 
@@ -2313,7 +2598,7 @@ VirtQueue *virtio_add_queue(VirtIODevice *vdev, int queue_size,
     vdev->vq[i].vring.num_default = queue_size;
     vdev->vq[i].vring.align = VIRTIO_PCI_VRING_ALIGN;
     vdev->vq[i].handle_output = handle_output;
-    vdev->vq[i].used_elems = g_new0(VirtQueueElement, queue_size);
+    vdev->vq[i].used_elems = g_new0(VirtQueueUsedElem, queue_size);
 
     return &vdev->vq[i];
 }
@@ -2326,6 +2611,7 @@ void virtio_delete_queue(VirtQueue *vq)
     g_free(vq->used_elems);
     vq->used_elems = NULL;
     virtio_virtqueue_reset_region_cache(vq);
+    virtio_virtqueue_reset_dma_cache(vq);
 }
 
 void virtio_del_queue(VirtIODevice *vdev, int n)
@@ -3459,10 +3745,45 @@ EventNotifier *virtio_queue_get_guest_notifier(VirtQueue *vq)
     return &vq->guest_notifier;
 }
 
+static void virtio_queue_poll_grow(VirtQueue *vq)
+{
+    int64_t old = vq->poll.poll_ns;
+
+    vq->poll.poll_ns = MIN(old * 2, VIRTIO_QUEUE_POLL_MAX_NS);
+    trace_virtio_queue_poll_grow(vq, old, vq->poll.poll_ns);
+}
+
+static void virtio_queue_poll_shrink(VirtQueue *vq)
+{
+    int64_t old = vq->poll.poll_ns;
+
+    vq->poll.poll_ns = old / 2;
+    if (vq->poll.poll_ns < VIRTIO_QUEUE_POLL_START_NS) {
+        vq->poll.poll_ns = 0;
+    }
+    trace_virtio_queue_poll_shrink(vq, old, vq->poll.poll_ns);
+}
+
+/* Stop suppressing notifications, the caller checks the ring once more */
+static void virtio_queue_poll_stop(VirtQueue *vq)
+{
+    if (vq->poll.active) {
+        vq->poll.active = false;
+        virtio_queue_set_notification(vq, 1);
+    }
+}
+
 static void virtio_queue_host_notifier_aio_poll_begin(EventNotifier *n)
 {
     VirtQueue *vq = container_of(n, VirtQueue, host_notifier);
 
+    if (!vq->poll.poll_ns) {
+        /* Not worth polling, keep waiting for kicks */
+        return;
+    }
+
+    vq->poll.start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    vq->poll.active = true;
     virtio_queue_set_notification(vq, 0);
 }
 
@@ -3471,13 +3792,36 @@ static bool virtio_queue_host_notifier_aio_poll(void *opaque)
     EventNotifier *n = opaque;
     VirtQueue *vq = container_of(n, VirtQueue, host_notifier);
 
-    return vq->vring.desc && !virtio_queue_empty(vq);
+    if (!vq->vring.desc) {
+        return false;
+    }
+
+    if (vq->poll.active &&
+        qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - vq->poll.start_ns >
+        vq->poll.poll_ns) {
+        /* Other handlers may keep polling, but this queue gave up */
+        vq->poll.misses++;
+        virtio_queue_poll_shrink(vq);
+        virtio_queue_poll_stop(vq);
+    }
+
+    return !virtio_queue_empty(vq);
 }
 
 static void virtio_queue_host_notifier_aio_poll_ready(EventNotifier *n)
 {
     VirtQueue *vq = container_of(n, VirtQueue, host_notifier);
 
+    if (vq->poll.active) {
+        int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
+        vq->poll.hits++;
+        if (now - vq->poll.start_ns > vq->poll.poll_ns / 2) {
+            virtio_queue_poll_grow(vq);
+        }
+        vq->poll.start_ns = now;
+    }
+
     virtio_queue_notify_vq(vq);
 }
 
@@ -3486,13 +3830,40 @@ static void virtio_queue_host_notifier_aio_poll_end(EventNotifier *n)
     VirtQueue *vq = container_of(n, VirtQueue, host_notifier);
 
     /* Caller polls once more after this to catch requests that race with us */
-    virtio_queue_set_notification(vq, 1);
+    virtio_queue_poll_stop(vq);
+}
+
+/*
+ * Account a guest kick.  A queue that is not polled starts polling again
+ * once kicks arrive faster than the initial budget would cover.
+ */
+static void virtio_queue_poll_kick(VirtQueue *vq)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
+    vq->poll.kicks++;
+    if (!vq->poll.poll_ns &&
+        now - vq->poll.last_kick_ns <= VIRTIO_QUEUE_POLL_START_NS * 4) {
+        vq->poll.poll_ns = VIRTIO_QUEUE_POLL_START_NS;
+        trace_virtio_queue_poll_grow(vq, 0, vq->poll.poll_ns);
+    }
+    vq->poll.last_kick_ns = now;
+}
+
+static void virtio_queue_host_notifier_aio_read(EventNotifier *n)
+{
+    VirtQueue *vq = container_of(n, VirtQueue, host_notifier);
+
+    if (event_notifier_test_and_clear(n)) {
+        virtio_queue_poll_kick(vq);
+        virtio_queue_notify_vq(vq);
+    }
 }
 
 void virtio_queue_aio_attach_host_notifier(VirtQueue *vq, AioContext *ctx)
 {
     aio_set_event_notifier(ctx, &vq->host_notifier,
-                           virtio_queue_host_notifier_read,
+                           virtio_queue_host_notifier_aio_read,
                            virtio_queue_host_notifier_aio_poll,
                            virtio_queue_host_notifier_aio_poll_ready);
     aio_set_event_notifier_poll(ctx, &vq->host_notifier,
@@ -3576,9 +3947,77 @@ void G_GNUC_PRINTF(2, 3) virtio_error(VirtIODevice *vdev, const char *fmt, ...)
     vdev->broken = true;
 }
 
+static void virtio_dma_iommu_unmap_notify(IOMMUNotifier *n,
+                                          IOMMUTLBEntry *iotlb)
+{
+    VirtIODMAIOMMU *iommu = container_of(n, VirtIODMAIOMMU, n);
+
+    virtio_reset_dma_cache(iommu->vdev);
+}
+
+static void virtio_memory_listener_region_add(MemoryListener *listener,
+                                              MemoryRegionSection *section)
+{
+    VirtIODevice *vdev = container_of(listener, VirtIODevice, listener);
+    IOMMUMemoryRegion *iommu_mr;
+    VirtIODMAIOMMU *iommu;
+    Int128 end;
+    int iommu_idx;
+
+    if (!memory_region_is_iommu(section->mr)) {
+        return;
+    }
+
+    iommu_mr = IOMMU_MEMORY_REGION(section->mr);
+    end = int128_add(int128_make64(section->offset_within_region),
+                     section->size);
+    end = int128_sub(end, int128_one());
+    iommu_idx = memory_region_iommu_attrs_to_index(iommu_mr,
+                                                   MEMTXATTRS_UNSPECIFIED);
+
+    iommu = g_new0(VirtIODMAIOMMU, 1);
+    iommu->vdev = vdev;
+    iommu->mr = section->mr;
+    iommu->start = section->offset_within_region;
+    iommu_notifier_init(&iommu->n, virtio_dma_iommu_unmap_notify,
+                        IOMMU_NOTIFIER_UNMAP,
+                        section->offset_within_region,
+                        int128_get64(end),
+                        iommu_idx);
+    /* If the vIOMMU cannot tell us about unmaps, the cache stays off */
+    iommu->registered =
+        !memory_region_register_iommu_notifier(section->mr, &iommu->n, NULL);
+    QLIST_INSERT_HEAD(&vdev->dma_iommus, iommu, next);
+}
+
+static void virtio_memory_listener_region_del(MemoryListener *listener,
+                                              MemoryRegionSection *section)
+{
+    VirtIODevice *vdev = container_of(listener, VirtIODevice, listener);
+    VirtIODMAIOMMU *iommu;
+
+    if (!memory_region_is_iommu(section->mr)) {
+        return;
+    }
+
+    QLIST_FOREACH(iommu, &vdev->dma_iommus, next) {
+        if (iommu->mr == section->mr &&
+            iommu->start == section->offset_within_region) {
+            if (iommu->registered) {
+                memory_region_unregister_iommu_notifier(iommu->mr, &iommu->n);
+            }
+            QLIST_REMOVE(iommu, next);
+            g_free(iommu);
+            break;
+        }
+    }
+}
+
 static void virtio_memory_listener_commit(MemoryListener *listener)
 {
     VirtIODevice *vdev = container_of(listener, VirtIODevice, listener);
+    VirtIODMAIOMMU *iommu;
+    bool enabled = !xen_enabled();
     int i;
 
     for (i = 0; i < VIRTIO_QUEUE_MAX; i++) {
@@ -3587,6 +4026,13 @@ static void virtio_memory_listener_commit(MemoryListener *listener)
         }
         virtio_init_region_cache(vdev, i);
     }
+
+    QLIST_FOREACH(iommu, &vdev->dma_iommus, next) {
+        enabled &= iommu->registered;
+    }
+    qatomic_set(&vdev->dma_cache_enabled, enabled);
+    qatomic_set(&vdev->dma_cache_widen, QLIST_EMPTY(&vdev->dma_iommus));
+    virtio_reset_dma_cache(vdev);
 }
 
 static void virtio_device_realize(DeviceState *dev, Error **errp)
@@ -3613,6 +4059,8 @@ static void virtio_device_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    vdev->listener.region_add = virtio_memory_listener_region_add;
+    vdev->listener.region_del = virtio_memory_listener_region_del;
     vdev->listener.commit = virtio_memory_listener_commit;
     vdev->listener.name = "virtio";
     memory_listener_register(&vdev->listener, vdev->dma_as);
@@ -3625,6 +4073,7 @@ static void virtio_device_unrealize(DeviceState *dev)
     VirtioDeviceClass *vdc = VIRTIO_DEVICE_GET_CLASS(dev);
 
     memory_listener_unregister(&vdev->listener);
+    virtio_reset_dma_cache(vdev);
     virtio_bus_device_unplugged(vdev);
 
     if (vdc->unrealize != NULL) {
@@ -3671,7 +4120,7 @@ static Property virtio_properties[] = {
     DEFINE_PROP_END_OF_LIST(),
 };
 
-static int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
+int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
     int i, n, r, err;
@@ -3741,7 +4190,7 @@ int virtio_device_start_ioeventfd(VirtIODevice *vdev)
     return virtio_bus_start_ioeventfd(vbus);
 }
 
-static void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
+void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
     int n, r;
@@ -3848,6 +4297,10 @@ VirtQueueStatus *qmp_x_query_virtio_queue_status(const char *path,
     status->used_idx = vdev->vq[queue].used_idx;
     status->signalled_used = vdev->vq[queue].signalled_used;
     status->signalled_used_valid = vdev->vq[queue].signalled_used_valid;
+    status->poll_ns = vdev->vq[queue].poll.poll_ns;
+    status->poll_kicks = vdev->vq[queue].poll.kicks;
+    status->poll_hits = vdev->vq[queue].poll.hits;
+    status->poll_misses = vdev->vq[queue].poll.misses;
 
     if (vdev->vhost_started) {
         VirtioDeviceClass *vdc = VIRTIO_DEVICE_GET_CLASS(vdev);
@@ -766,6 +766,7 @@ struct MemoryRegion {
     bool nonvolatile;
     bool rom_device;
     bool flush_coalesced_mmio;
+    bool lockless_io;
     uint8_t dirty_log_mask;
     bool is_iommu;
     RAMBlock *ram_block;
@@ -2189,6 +2190,24 @@ void memory_region_set_flush_coalesced(MemoryRegion *mr);
  */
 void memory_region_clear_flush_coalesced(MemoryRegion *mr);
 
+/**
+ * memory_region_enable_lockless_io: Dispatch accesses without the BQL.
+ *
+ * By default, MMIO and PIO accesses from vCPUs are dispatched with the BQL
+ * held, serializing all vCPUs that exit to access a device.  After calling
+ * this, the callbacks of @mr are invoked without it, possibly concurrently
+ * from several vCPU threads, and must do their own locking.  Meant for
+ * registers that are hot and whose callbacks are trivially thread-safe,
+ * such as free-running counters.
+ *
+ * The re-entrancy guard is disabled for @mr, as it is not thread-safe.
+ * Accesses to regions that need coalesced MMIO to be flushed first still
+ * take the BQL.
+ *
+ * @mr: the memory region to be updated.
+ */
+void memory_region_enable_lockless_io(MemoryRegion *mr);
+
 /**
  * memory_region_add_eventfd: Request an eventfd to be triggered when a word
  *                            is written to a location.
@@ -66,6 +66,14 @@ struct RAMBlock {
     unsigned long *clear_bmap;
     uint8_t clear_bmap_shift;
 
+    /*
+     * bitmap of pages the guest reported as free (and that got discarded)
+     * since the last dirty bitmap sync, which therefore read as zero.
+     * Only used on the src side of ram migration, protected by the
+     * global ram_state.bitmap_mutex.
+     */
+    unsigned long *free_bmap;
+
     /*
      * RAM block length that corresponds to the used_length on the migration
      * source (after RAM block sizes were synchronized). Especially, after
@@ -237,6 +237,18 @@ typedef struct SavedIOTLB {
 } SavedIOTLB;
 #endif
 
+/*
+ * Sections of the memory dispatch recently hit by this CPU, see
+ * address_space_lookup_region().  @gen identifies the dispatch (and
+ * thus the FlatView) @section belongs to.
+ */
+#define CPU_DISPATCH_CACHE_SIZE 4
+
+typedef struct CPUDispatchCacheEntry {
+    uint64_t gen;
+    MemoryRegionSection *section;
+} CPUDispatchCacheEntry;
+
 struct KVMState;
 struct kvm_run;
 
@@ -300,6 +312,9 @@ struct qemu_work_item;
  * @num_ases: number of CPUAddressSpaces in @cpu_ases
  * @as: Pointer to the first AddressSpace, for the convenience of targets which
  *      only have a single AddressSpace
+ * @dispatch_cache: Sections of the memory dispatch recently hit by this CPU,
+ *    only accessed from the CPU's own thread.
+ * @dispatch_cache_next: Next @dispatch_cache entry to replace.
  * @env_ptr: Pointer to subclass-specific CPUArchState field.
  * @icount_decr_ptr: Pointer to IcountDecr field within subclass.
  * @gdb_regs: Additional GDB registers.
@@ -371,6 +386,8 @@ struct CPUState {
     int num_ases;
     AddressSpace *as;
     MemoryRegion *memory;
+    CPUDispatchCacheEntry dispatch_cache[CPU_DISPATCH_CACHE_SIZE];
+    unsigned dispatch_cache_next;
 
     CPUArchState *env_ptr;
     IcountDecr *icount_decr_ptr;
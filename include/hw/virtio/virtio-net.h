@@ -20,6 +20,7 @@
 #include "net/announce.h"
 #include "qemu/option_int.h"
 #include "qom/object.h"
+#include "sysemu/iothread.h"
 
 #include "ebpf/ebpf_rss.h"
 
@@ -87,6 +88,8 @@ typedef struct VirtioNetRscStat {
     uint32_t ip_ecn;
     uint32_t ip_hacked;
     uint32_t ip_option;
+    uint32_t csum_unverified;
+    uint32_t gso_mismatch;
     uint32_t purge_failed;
     uint32_t drain_failed;
     uint32_t final_failed;
@@ -102,6 +105,12 @@ typedef struct VirtioNetRscUnit {
     uint16_t payload;       /* pure payload without virtio/eth/ip/tcp */
 } VirtioNetRscUnit;
 
+/* Flow lookup key: source and destination addresses, then ports */
+typedef struct VirtioNetRscFlow {
+    uint64_t addrs[4];      /* ipv4 uses the first 8 bytes */
+    uint32_t ports;
+} VirtioNetRscFlow;
+
 /* Coalesced segment */
 typedef struct VirtioNetRscSeg {
     QTAILQ_ENTRY(VirtioNetRscSeg) next;
@@ -109,8 +118,10 @@ typedef struct VirtioNetRscSeg {
     size_t size;
     uint16_t packets;
     uint16_t dup_ack;
+    uint16_t mss;           /* payload of the first data segment */
     bool is_coalesced;      /* need recal ipv4 header checksum, mark here */
     VirtioNetRscUnit unit;
+    VirtioNetRscFlow flow;
     NetClientState *nc;
 } VirtioNetRscSeg;
 
@@ -124,6 +135,7 @@ typedef struct VirtioNetRscChain {
     uint16_t max_payload;
     QEMUTimer *drain_timer;
     QTAILQ_HEAD(, VirtioNetRscSeg) buffers;
+    GHashTable *flows;      /* VirtioNetRscFlow -> VirtioNetRscSeg */
     VirtioNetRscStat stat;
 } VirtioNetRscChain;
 
@@ -154,6 +166,12 @@ typedef struct VirtIONetQueue {
     struct {
         VirtQueueElement *elem;
     } async_tx;
+    /* RX elements filled but not yet flushed, see virtio_net_rx_flush() */
+    unsigned int rx_pending;
+    /* Receive batch nesting depth while the queue pair runs in an IOThread */
+    unsigned int rx_batch;
+    /* IOThread context processing the queue pair, NULL for the main loop */
+    AioContext *ctx;
     struct VirtIONet *n;
 } VirtIONetQueue;
 
@@ -164,6 +182,8 @@ struct VirtIONet {
     VirtIONetQueue *vqs;
     VirtQueue *ctrl_vq;
     NICState *nic;
+    /* Nesting depth of receive batches, RX completions are deferred if > 0 */
+    unsigned int rx_batch;
     /* RSC Chains - temporary storage of coalesced data,
        all these data are lost in case of migration */
     QTAILQ_HEAD(, VirtioNetRscChain) rsc_chains;
@@ -176,6 +196,9 @@ struct VirtIONet {
     uint32_t rsc_timeout;
     uint8_t rsc4_enabled;
     uint8_t rsc6_enabled;
+    /* Coalesce for any TSO capable driver, see virtio_net_update_rsc() */
+    bool rx_coalesce;
+    bool rsc_gro;
     uint8_t has_ufo;
     uint32_t mergeable_rx_bufs;
     uint8_t promisc;
@@ -219,6 +242,16 @@ struct VirtIONet {
     VirtioNetRssData rss_data;
     struct NetRxPkt *rx_pkt;
     struct EBPFRSSContext ebpf_rss;
+    /* IOThreads the queue pairs are spread over, see "iothreads" property */
+    strList *iothread_ids;
+    IOThread **iothreads;
+    uint32_t num_iothreads;
+    bool ioeventfd_started;
+    bool dataplane_started;
+    /* Keeps the queue pairs in the main loop, e.g. during control commands */
+    bool dataplane_blocked;
+    /* vdev->use_guest_notifier_mask, cleared while dataplane is started */
+    bool dataplane_saved_notifier_mask;
 };
 
 size_t virtio_net_handle_ctrl_iov(VirtIODevice *vdev,
@@ -58,6 +58,7 @@ size_t virtio_get_config_size(const VirtIOConfigSizeParams *params,
                               uint64_t host_features);
 
 typedef struct VirtQueue VirtQueue;
+typedef struct VirtIODMAIOMMU VirtIODMAIOMMU;
 
 #define VIRTQUEUE_MAX_SIZE 1024
 
@@ -156,6 +157,10 @@ struct VirtIODevice
     QTAILQ_ENTRY(VirtIODevice) next;
     EventNotifier config_notifier;
     bool device_iotlb_enabled;
+    /* DMA mapping cache state, updated by the memory listener */
+    QLIST_HEAD(, VirtIODMAIOMMU) dma_iommus;
+    bool dma_cache_enabled;
+    bool dma_cache_widen;
 };
 
 struct VirtioDeviceClass {
@@ -250,6 +255,20 @@ void virtqueue_fill(VirtQueue *vq, const VirtQueueElement *elem,
 
 void virtqueue_map(VirtIODevice *vdev, VirtQueueElement *elem);
 void *virtqueue_pop(VirtQueue *vq, size_t sz);
+/**
+ * virtqueue_pop_batch:
+ * @vq: The #VirtQueue
+ * @sz: The size of each element, as for virtqueue_pop()
+ * @elems: Array to receive up to @max elements
+ * @max: The maximum number of elements to pop
+ *
+ * Equivalent to calling virtqueue_pop() until it returns NULL or @max
+ * elements have been popped, but with less per-element overhead.
+ *
+ * Returns: the number of elements stored in @elems.
+ */
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max);
 unsigned int virtqueue_drop_all(VirtQueue *vq);
 void *qemu_get_virtqueue_element(VirtIODevice *vdev, QEMUFile *f, size_t sz);
 void qemu_put_virtqueue_element(VirtIODevice *vdev, QEMUFile *f,
@@ -369,6 +388,9 @@ EventNotifier *virtio_queue_get_guest_notifier(VirtQueue *vq);
 void virtio_queue_set_guest_notifier_fd_handler(VirtQueue *vq, bool assign,
                                                 bool with_irqfd);
 int virtio_device_start_ioeventfd(VirtIODevice *vdev);
+/* Default VirtioDeviceClass::start_ioeventfd/stop_ioeventfd, for overriders */
+int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev);
+void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev);
 int virtio_device_grab_ioeventfd(VirtIODevice *vdev);
 void virtio_device_release_ioeventfd(VirtIODevice *vdev);
 bool virtio_device_ioeventfd_enabled(VirtIODevice *vdev);
@@ -40,6 +40,7 @@ int precopy_notify(PrecopyNotifyReason reason, Error **errp);
 
 void ram_mig_init(void);
 void qemu_guest_free_page_hint(void *addr, size_t len);
+void qemu_guest_free_page_report(void *addr, size_t len);
 
 /* migration/block.c */
 
@@ -108,4 +108,35 @@ void net_toeplitz_add(uint32_t *result,
     *result = accumulator;
 }
 
+/* RSS keys are 40 bytes, enough to hash up to 36 bytes of input */
+#define NET_TOEPLITZ_KEY_SIZE   40
+#define NET_TOEPLITZ_MAX_INPUT  (NET_TOEPLITZ_KEY_SIZE - sizeof(uint32_t))
+
+/*
+ * Toeplitz hash contributions of every possible value of each input byte,
+ * precomputed for one key.  Hashing then takes one lookup per input byte
+ * instead of one step per input bit.
+ */
+typedef struct NetToeplitzTable {
+    uint8_t key[NET_TOEPLITZ_KEY_SIZE];
+    uint32_t table[NET_TOEPLITZ_MAX_INPUT][256];
+} NetToeplitzTable;
+
+void net_toeplitz_table_init(NetToeplitzTable *t, const uint8_t *key);
+
+static inline
+uint32_t net_toeplitz_table_hash(const NetToeplitzTable *t,
+                                 const uint8_t *input, uint32_t len)
+{
+    uint32_t result = 0;
+    uint32_t byte;
+
+    assert(len <= NET_TOEPLITZ_MAX_INPUT);
+    for (byte = 0; byte < len; byte++) {
+        result ^= t->table[byte][input[byte]];
+    }
+
+    return result;
+}
+
 #endif /* QEMU_NET_CHECKSUM_H */
@@ -639,21 +639,78 @@ void qemu_set_tty_echo(int fd, bool echo);
 
 typedef struct ThreadContext ThreadContext;
 
+/**
+ * QemuPreallocOptions:
+ * @max_threads: maximum number of threads to use, at least 1
+ * @tc: prealloc context threads pointer, NULL if not in use
+ * @async: request asynchronous preallocation, optional
+ * @name: name of the memory the area belongs to for error messages, or NULL
+ * @collapse: collapse the preallocated memory into transparent huge pages
+ */
+typedef struct QemuPreallocOptions {
+    int max_threads;
+    ThreadContext *tc;
+    bool async;
+    const char *name;
+    bool collapse;
+} QemuPreallocOptions;
+
 /**
  * qemu_prealloc_mem:
  * @fd: the fd mapped into the area, -1 for anonymous memory
  * @area: start address of the are to preallocate
  * @sz: the size of the area to preallocate
- * @max_threads: maximum number of threads to use
+ * @opts: how to preallocate
  * @errp: returns an error if this function fails
  *
  * Preallocate memory (populate/prefault page tables writable) for the virtual
  * memory area starting at @area with the size of @sz. After a successful call,
  * each page in the area was faulted in writable at least once, for example,
  * after allocating file blocks for mapped files.
+ *
+ * When setting @async, allocation might be performed asynchronously.
+ * qemu_finish_async_prealloc_mem() must be called to finish any asynchronous
+ * preallocation. Asynchronous preallocation is only possible if the area is
+ * not accessed concurrently in a way that would modify its content.
+ *
+ * When setting @collapse, parts of the area the kernel had to populate using
+ * small pages are collapsed into transparent huge pages where possible. This
+ * is best effort and only done for areas not backed by hugetlb pages.
+ */
+void qemu_prealloc_mem(int fd, char *area, size_t sz,
+                       const QemuPreallocOptions *opts, Error **errp);
+
+/**
+ * qemu_finish_async_prealloc_mem:
+ * @errp: returns an error if this function fails
+ *
+ * Finish all outstanding asynchronous memory preallocation, waiting for it
+ * to complete. Must be called with the BQL held, just like
+ * qemu_prealloc_mem().
+ *
+ * Returns true on success, false if any preallocation failed.
+ */
+bool qemu_finish_async_prealloc_mem(Error **errp);
+
+typedef struct QemuThpArea {
+    void *area;
+    size_t size;
+    uint64_t thp_size;
+} QemuThpArea;
+
+/**
+ * qemu_get_thp_backed_size:
+ * @areas: the areas to query
+ * @nr_areas: the number of areas
+ *
+ * Set @thp_size of each area to the number of bytes of the area currently
+ * backed by transparent huge pages. The memory map of the process is
+ * parsed once for all areas; huge pages of a mapping that only partially
+ * overlaps an area are accounted in proportion to the overlap.
+ *
+ * Returns false if that cannot be determined on this host.
  */
-void qemu_prealloc_mem(int fd, char *area, size_t sz, int max_threads,
-                       ThreadContext *tc, Error **errp);
+bool qemu_get_thp_backed_size(QemuThpArea *areas, int nr_areas);
 
 /**
  * qemu_get_pid_name:
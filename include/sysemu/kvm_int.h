@@ -40,6 +40,9 @@ typedef struct KVMMemoryUpdate {
 typedef struct KVMMemoryListener {
     MemoryListener listener;
     KVMSlot *slots;
+    /* Number of slots in use, and size of the slots array */
+    int nr_slots_used;
+    int nr_slots_allocated;
     int as_id;
     QSIMPLEQ_HEAD(, KVMMemoryUpdate) transaction_add;
     QSIMPLEQ_HEAD(, KVMMemoryUpdate) transaction_del;
@@ -69,7 +72,7 @@ struct KVMState
 {
     AccelState parent_obj;
 
-    int nr_slots;
+    int nr_slots_max;
     int fd;
     int vmfd;
     int coalesced_mmio;
@@ -2772,6 +2772,43 @@ static void pgb_dynamic(const char *image_name, long align)
     }
 }
 
+/*
+ * Try to reserve the guest address space with guest_base == 0, so that
+ * generated code may access guest memory without adding an offset.
+ * The host will not map anything below mmap_min_addr, so neither will
+ * the guest, just as if it were running natively on this host.
+ * A low commpage would need exactly such a mapping, so do not try.
+ */
+static bool pgb_reserved_va_identity(void)
+{
+    int flags = MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE;
+    uintptr_t lo = ROUND_UP(mmap_min_addr, qemu_host_page_size);
+    size_t size;
+    void *addr;
+
+    if (sizeof(uintptr_t) < 8 || LO_COMMPAGE != -1 || lo > reserved_va) {
+        return false;
+    }
+
+    /* osdep.h defines this as 0 if it's missing */
+    flags |= MAP_FIXED_NOREPLACE;
+
+    size = reserved_va - lo + 1;
+    addr = mmap((void *)lo, size, PROT_NONE, flags, -1, 0);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    if (addr != (void *)lo) {
+        munmap(addr, size);
+        return false;
+    }
+
+    guest_base = 0;
+    qemu_log_mask(CPU_LOG_PAGE, "%s: identity map @ %p for %zu bytes\n",
+                  __func__, addr, size);
+    return true;
+}
+
 static void pgb_reserved_va(const char *image_name, abi_ulong guest_loaddr,
                             abi_ulong guest_hiaddr, long align)
 {
@@ -2785,6 +2822,12 @@ static void pgb_reserved_va(const char *image_name, abi_ulong guest_loaddr,
         exit(EXIT_FAILURE);
     }
 
+    /* A zero guest_loaddr means a dynamic image, which may go anywhere. */
+    if ((guest_loaddr == 0 || guest_loaddr >= mmap_min_addr) &&
+        pgb_reserved_va_identity()) {
+        return;
+    }
+
     /* Widen the "image" to the entire reserved address space. */
     pgb_static(image_name, 0, reserved_va, align);
 
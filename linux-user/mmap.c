@@ -270,7 +270,7 @@ unsigned long last_brk;
 static abi_ulong mmap_find_vma_reserved(abi_ulong start, abi_ulong size,
                                         abi_ulong align)
 {
-    abi_ulong addr, end_addr, incr = qemu_host_page_size;
+    abi_ulong addr, end_addr, min_addr, incr = qemu_host_page_size;
     int prot;
     bool looped = false;
 
@@ -278,6 +278,12 @@ static abi_ulong mmap_find_vma_reserved(abi_ulong start, abi_ulong size,
         return (abi_ulong)-1;
     }
 
+    /*
+     * With guest_base == 0, the host will not map anything below
+     * mmap_min_addr on behalf of the guest; see pgb_reserved_va.
+     */
+    min_addr = guest_base ? 0 : mmap_min_addr;
+
     /* Note that start and size have already been aligned by mmap_find_vma. */
 
     end_addr = start + size;
@@ -291,7 +297,7 @@ static abi_ulong mmap_find_vma_reserved(abi_ulong start, abi_ulong size,
     addr = end_addr;
     while (1) {
         addr -= incr;
-        if (addr > end_addr) {
+        if (addr > end_addr || addr < min_addr) {
             if (looped) {
                 /* Failure.  The entire address space has been searched.  */
                 return (abi_ulong)-1;
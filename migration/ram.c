@@ -379,6 +379,8 @@ struct RAMState {
     uint64_t target_page_count;
     /* number of dirty bits in the bitmap */
     uint64_t migration_dirty_pages;
+    /* whether any RAMBlock free_bmap has bits set since the last sync */
+    bool free_pages_reported;
     /*
      * Protects:
      * - dirty/clear bitmap
@@ -1030,7 +1032,16 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
     WITH_RCU_READ_LOCK_GUARD() {
         RAMBLOCK_FOREACH_NOT_IGNORED(block) {
             ramblock_sync_dirty_bitmap(rs, block);
+            /*
+             * Reported free pages that the guest has reused since are dirty
+             * again now, so they can no longer be assumed to be zero.
+             */
+            if (rs->free_pages_reported) {
+                bitmap_zero(block->free_bmap,
+                            block->used_length >> TARGET_PAGE_BITS);
+            }
         }
+        rs->free_pages_reported = false;
         stat64_set(&mig_stats.dirty_bytes_last_sync, ram_bytes_remaining());
     }
     qemu_mutex_unlock(&rs->bitmap_mutex);
@@ -1088,6 +1099,20 @@ void ram_release_page(const char *rbname, uint64_t offset)
     ram_discard_range(rbname, offset, TARGET_PAGE_SIZE);
 }
 
+/*
+ * Pages the guest reported as free were discarded and read as zero, unless
+ * the guest has reused them since; in that case they are dirty again and
+ * will be resent after the next bitmap sync anyway.  Either way there is no
+ * need to read (and thereby repopulate) them to find out they are zero.
+ *
+ * Called with ram_state.bitmap_mutex held.
+ */
+static bool ram_page_reported_free(RAMBlock *block, ram_addr_t offset)
+{
+    return block->free_bmap &&
+           test_bit(offset >> TARGET_PAGE_BITS, block->free_bmap);
+}
+
 /**
  * save_zero_page_to_file: send the zero page to the file
  *
@@ -1104,7 +1129,8 @@ static int save_zero_page_to_file(PageSearchStatus *pss, QEMUFile *file,
     uint8_t *p = block->host + offset;
     int len = 0;
 
-    if (buffer_is_zero(p, TARGET_PAGE_SIZE)) {
+    if (ram_page_reported_free(block, offset) ||
+        buffer_is_zero(p, TARGET_PAGE_SIZE)) {
         len += save_page_header(pss, file, block, offset | RAM_SAVE_FLAG_ZERO);
         qemu_put_byte(file, 0);
         len += 1;
@@ -2464,6 +2490,8 @@ static void ram_save_cleanup(void *opaque)
     RAMBLOCK_FOREACH_NOT_IGNORED(block) {
         g_free(block->clear_bmap);
         block->clear_bmap = NULL;
+        g_free(block->free_bmap);
+        block->free_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
     }
@@ -2835,6 +2863,7 @@ static void ram_list_init_bitmaps(void)
             bitmap_set(block->bmap, 0, pages);
             block->clear_bmap_shift = shift;
             block->clear_bmap = bitmap_new(clear_bmap_size(pages, shift));
+            block->free_bmap = bitmap_new(pages);
         }
     }
 }
@@ -2973,6 +3002,67 @@ void qemu_guest_free_page_hint(void *addr, size_t len)
     }
 }
 
+/*
+ * qemu_guest_free_page_report: the guest reported free pages that have been
+ * discarded
+ *
+ * @addr: host address of the first discarded page
+ * @len: length of the discarded range in bytes
+ *
+ * Unlike hinted pages, reported pages are discarded on the source and the
+ * guest may rely on them reading as zero afterwards.  Mark them dirty so that
+ * the destination does not keep stale contents from an earlier round, and
+ * remember that they are zero so that sending them neither reads nor
+ * repopulates the discarded memory.
+ *
+ * Must be called with the BQL held, which keeps the bitmaps from being set up
+ * or torn down underneath us.
+ */
+void qemu_guest_free_page_report(void *addr, size_t len)
+{
+    RAMBlock *block;
+    ram_addr_t offset;
+    size_t used_len, start, npages;
+    MigrationState *s = migrate_get_current();
+
+    /* Postcopy sends whatever the source has once the guest stopped */
+    if (!migration_is_setup_or_active(s->state) || migration_in_postcopy() ||
+        migrate_background_snapshot()) {
+        return;
+    }
+
+    for (; len > 0; len -= used_len, addr += used_len) {
+        block = qemu_ram_block_from_host(addr, false, &offset);
+        if (unlikely(!block || offset >= block->used_length)) {
+            error_report_once("%s unexpected error", __func__);
+            return;
+        }
+
+        if (len <= block->used_length - offset) {
+            used_len = len;
+        } else {
+            used_len = block->used_length - offset;
+        }
+
+        /* Not migrated, or the RAM state is not set up (yet) */
+        if (!block->free_bmap) {
+            continue;
+        }
+
+        start = offset >> TARGET_PAGE_BITS;
+        npages = used_len >> TARGET_PAGE_BITS;
+        trace_qemu_guest_free_page_report(block->idstr, offset, used_len);
+
+        qemu_mutex_lock(&ram_state->bitmap_mutex);
+        ram_state->migration_dirty_pages += npages -
+                      bitmap_count_one_with_offset(block->bmap, start, npages);
+        bitmap_set(block->bmap, start, npages);
+        bitmap_set(block->free_bmap, start, npages);
+        ram_state->free_pages_reported = true;
+        qemu_mutex_unlock(&ram_state->bitmap_mutex);
+    }
+}
+
 /*
  * Each of ram_save_setup, ram_save_iterate and ram_save_complete has
  * long-running RCU critical section.  When rcu-reclaims in the code
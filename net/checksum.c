@@ -206,3 +206,27 @@ net_checksum_add_iov(const struct iovec *iov, const unsigned int iov_cnt,
     }
     return res;
 }
+
+void net_toeplitz_table_init(NetToeplitzTable *t, const uint8_t *key)
+{
+    uint8_t padded[NET_TOEPLITZ_KEY_SIZE + sizeof(uint32_t)] = { 0 };
+    unsigned int byte, bit, v;
+
+    memcpy(t->key, key, NET_TOEPLITZ_KEY_SIZE);
+    memcpy(padded, key, NET_TOEPLITZ_KEY_SIZE);
+
+    for (byte = 0; byte < NET_TOEPLITZ_MAX_INPUT; byte++) {
+        /* Key bits [8 * byte, 8 * byte + 64) */
+        uint64_t window = ldq_be_p(&padded[byte]);
+        uint32_t *row = t->table[byte];
+
+        row[0] = 0;
+        /* Input bit 7 - bit selects the 32 key bits starting at its offset */
+        for (bit = 0; bit < 8; bit++) {
+            row[0x80 >> bit] = window >> (32 - bit);
+        }
+        for (v = 1; v < 256; v++) {
+            row[v] = row[v & (v - 1)] ^ row[v & -v];
+        }
+    }
+}
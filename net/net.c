@@ -49,6 +49,7 @@
 #include "qemu/main-loop.h"
 #include "qemu/option.h"
 #include "qemu/keyval.h"
+#include "block/aio.h"
 #include "qapi/error.h"
 #include "qapi/opts-visitor.h"
 #include "sysemu/runstate.h"
@@ -660,17 +661,53 @@ static ssize_t filter_receive(NetClientState *nc,
     return filter_receive_iov(nc, direction, sender, flags, &iov, 1, sent_cb);
 }
 
+static void qemu_net_client_lock(AioContext *ctx)
+{
+    if (ctx) {
+        aio_context_acquire(ctx);
+    }
+}
+
+static void qemu_net_client_unlock(AioContext *ctx)
+{
+    if (ctx) {
+        aio_context_release(ctx);
+    }
+}
+
+static void qemu_receive_batch_begin(NetClientState *nc)
+{
+    if (nc->info->receive_batch_begin) {
+        nc->info->receive_batch_begin(nc);
+    }
+}
+
+static void qemu_receive_batch_end(NetClientState *nc)
+{
+    if (nc->info->receive_batch_end) {
+        nc->info->receive_batch_end(nc);
+    }
+}
+
 void qemu_purge_queued_packets(NetClientState *nc)
 {
+    AioContext *ctx = nc->ctx;
+
     if (!nc->peer) {
         return;
     }
 
+    qemu_net_client_lock(ctx);
     qemu_net_queue_purge(nc->peer->incoming_queue, nc);
+    qemu_net_client_unlock(ctx);
 }
 
 void qemu_flush_or_purge_queued_packets(NetClientState *nc, bool purge)
 {
+    AioContext *ctx = nc->ctx;
+    bool flushed;
+
+    qemu_net_client_lock(ctx);
     nc->receive_disabled = 0;
 
     if (nc->peer && nc->peer->info->type == NET_CLIENT_DRIVER_HUBPORT) {
@@ -678,7 +715,10 @@ void qemu_flush_or_purge_queued_packets(NetClientState *nc, bool purge)
             qemu_notify_event();
         }
     }
-    if (qemu_net_queue_flush(nc->incoming_queue)) {
+    qemu_receive_batch_begin(nc);
+    flushed = qemu_net_queue_flush(nc->incoming_queue);
+    qemu_receive_batch_end(nc);
+    if (flushed) {
         /* We emptied the queue successfully, signal to the IO thread to repoll
          * the file descriptor (for tap, for example).
          */
@@ -687,6 +727,7 @@ void qemu_flush_or_purge_queued_packets(NetClientState *nc, bool purge)
         /* Unable to empty the queue, purge remaining packets */
         qemu_net_queue_purge(nc->incoming_queue, nc->peer);
     }
+    qemu_net_client_unlock(ctx);
 }
 
 void qemu_flush_queued_packets(NetClientState *nc)
@@ -694,10 +735,10 @@ void qemu_flush_queued_packets(NetClientState *nc)
     qemu_flush_or_purge_queued_packets(nc, false);
 }
 
-static ssize_t qemu_send_packet_async_with_flags(NetClientState *sender,
-                                                 unsigned flags,
-                                                 const uint8_t *buf, int size,
-                                                 NetPacketSent *sent_cb)
+static ssize_t qemu_send_packet_async_locked(NetClientState *sender,
+                                             unsigned flags,
+                                             const uint8_t *buf, int size,
+                                             NetPacketSent *sent_cb)
 {
     NetQueue *queue;
     int ret;
@@ -729,6 +770,20 @@ static ssize_t qemu_send_packet_async_with_flags(NetClientState *sender,
     return qemu_net_queue_send(queue, sender, flags, buf, size, sent_cb);
 }
 
+static ssize_t qemu_send_packet_async_with_flags(NetClientState *sender,
+                                                 unsigned flags,
+                                                 const uint8_t *buf, int size,
+                                                 NetPacketSent *sent_cb)
+{
+    AioContext *ctx = sender->ctx;
+    ssize_t ret;
+
+    qemu_net_client_lock(ctx);
+    ret = qemu_send_packet_async_locked(sender, flags, buf, size, sent_cb);
+    qemu_net_client_unlock(ctx);
+    return ret;
+}
+
 ssize_t qemu_send_packet_async(NetClientState *sender,
                                const uint8_t *buf, int size,
                                NetPacketSent *sent_cb)
@@ -737,6 +792,54 @@ ssize_t qemu_send_packet_async(NetClientState *sender,
                                              buf, size, sent_cb);
 }
 
+/*
+ * Bracket a burst of packets sent by @nc, so that the peer can amortize
+ * its per-packet completion work (e.g. used ring updates and guest
+ * notifications) over the whole burst.
+ */
+void qemu_send_batch_begin(NetClientState *nc)
+{
+    if (nc->peer) {
+        qemu_receive_batch_begin(nc->peer);
+    }
+}
+
+void qemu_send_batch_end(NetClientState *nc)
+{
+    if (nc->peer) {
+        qemu_receive_batch_end(nc->peer);
+    }
+}
+
+/*
+ * Whether the packets between @nc and its peer can be processed in an
+ * AioContext other than the main loop.  Filters and hubs rely on the
+ * main loop, so only direct connections to a capable peer qualify.
+ */
+bool qemu_can_set_aio_context(NetClientState *nc)
+{
+    NetClientState *peer = nc->peer;
+
+    return peer && peer->info->set_aio_context &&
+           QTAILQ_EMPTY(&nc->filters) && QTAILQ_EMPTY(&peer->filters);
+}
+
+/*
+ * Move @nc and its peer to @ctx, or back to the main loop if @ctx is
+ * NULL.  Must be called from the thread that currently runs the pair.
+ */
+void qemu_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    NetClientState *peer = nc->peer;
+
+    assert(!ctx || qemu_can_set_aio_context(nc));
+    if (peer) {
+        peer->info->set_aio_context(peer, ctx);
+        assert(peer->ctx == ctx);
+    }
+    nc->ctx = ctx;
+}
+
 ssize_t qemu_send_packet(NetClientState *nc, const uint8_t *buf, int size)
 {
     return qemu_send_packet_async(nc, buf, size, NULL);
@@ -829,9 +932,10 @@ static ssize_t qemu_deliver_packet_iov(NetClientState *sender,
     return ret;
 }
 
-ssize_t qemu_sendv_packet_async(NetClientState *sender,
-                                const struct iovec *iov, int iovcnt,
-                                NetPacketSent *sent_cb)
+static ssize_t qemu_sendv_packet_async_locked(NetClientState *sender,
+                                              const struct iovec *iov,
+                                              int iovcnt,
+                                              NetPacketSent *sent_cb)
 {
     NetQueue *queue;
     size_t size = iov_size(iov, iovcnt);
@@ -865,6 +969,19 @@ ssize_t qemu_sendv_packet_async(NetClientState *sender,
                                    iov, iovcnt, sent_cb);
 }
 
+ssize_t qemu_sendv_packet_async(NetClientState *sender,
+                                const struct iovec *iov, int iovcnt,
+                                NetPacketSent *sent_cb)
+{
+    AioContext *ctx = sender->ctx;
+    ssize_t ret;
+
+    qemu_net_client_lock(ctx);
+    ret = qemu_sendv_packet_async_locked(sender, iov, iovcnt, sent_cb);
+    qemu_net_client_unlock(ctx);
+    return ret;
+}
+
 ssize_t
 qemu_sendv_packet(NetClientState *nc, const struct iovec *iov, int iovcnt)
 {
@@ -1082,6 +1199,9 @@ static int (* const net_client_init_fun[NET_CLIENT_DRIVER__MAX])(
 #ifdef CONFIG_NETMAP
         [NET_CLIENT_DRIVER_NETMAP]    = net_init_netmap,
 #endif
+#ifdef CONFIG_AF_XDP
+        [NET_CLIENT_DRIVER_AF_XDP]    = net_init_af_xdp,
+#endif
 #ifdef CONFIG_NET_BRIDGE
         [NET_CLIENT_DRIVER_BRIDGE]    = net_init_bridge,
 #endif
@@ -1186,6 +1306,9 @@ void show_netdevs(void)
 #ifdef CONFIG_NETMAP
         "netmap",
 #endif
+#ifdef CONFIG_AF_XDP
+        "af-xdp",
+#endif
 #ifdef CONFIG_POSIX
         "vhost-user",
 #endif
@@ -32,6 +32,7 @@
 #include "qemu/sockets.h"
 #include "qemu/iov.h"
 #include "qemu/main-loop.h"
+#include "block/aio.h"
 
 typedef struct NetSocketState {
     NetClientState nc;
@@ -46,14 +47,20 @@ typedef struct NetSocketState {
 } NetSocketState;
 
 static void net_socket_accept(void *opaque);
+static void net_socket_readable(void *opaque);
 static void net_socket_writable(void *opaque);
 
 static void net_socket_update_fd_handler(NetSocketState *s)
 {
-    qemu_set_fd_handler(s->fd,
-                        s->read_poll ? s->send_fn : NULL,
-                        s->write_poll ? net_socket_writable : NULL,
-                        s);
+    IOHandler *fd_read = s->read_poll ? net_socket_readable : NULL;
+    IOHandler *fd_write = s->write_poll ? net_socket_writable : NULL;
+
+    if (s->nc.ctx) {
+        aio_set_fd_handler(s->nc.ctx, s->fd, fd_read, fd_write,
+                           NULL, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->fd, fd_read, fd_write, s);
+    }
 }
 
 static void net_socket_read_poll(NetSocketState *s, bool enable)
@@ -68,13 +75,34 @@ static void net_socket_write_poll(NetSocketState *s, bool enable)
     net_socket_update_fd_handler(s);
 }
 
+static void net_socket_readable(void *opaque)
+{
+    NetSocketState *s = opaque;
+    AioContext *ctx = s->nc.ctx;
+
+    if (ctx) {
+        aio_context_acquire(ctx);
+    }
+    s->send_fn(s);
+    if (ctx) {
+        aio_context_release(ctx);
+    }
+}
+
 static void net_socket_writable(void *opaque)
 {
     NetSocketState *s = opaque;
+    AioContext *ctx = s->nc.ctx;
 
+    if (ctx) {
+        aio_context_acquire(ctx);
+    }
     net_socket_write_poll(s, false);
 
     qemu_flush_queued_packets(&s->nc);
+    if (ctx) {
+        aio_context_release(ctx);
+    }
 }
 
 static ssize_t net_socket_receive(NetClientState *nc, const uint8_t *buf, size_t size)
@@ -319,11 +347,31 @@ static void net_socket_cleanup(NetClientState *nc)
     }
 }
 
+static void net_socket_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
+
+    if (s->fd < 0) {
+        nc->ctx = ctx;
+        return;
+    }
+
+    /* Unregister from the old context before registering in the new one */
+    if (nc->ctx) {
+        aio_set_fd_handler(nc->ctx, s->fd, NULL, NULL, NULL, NULL, NULL);
+    } else {
+        qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
+    }
+    nc->ctx = ctx;
+    net_socket_update_fd_handler(s);
+}
+
 static NetClientInfo net_dgram_socket_info = {
     .type = NET_CLIENT_DRIVER_SOCKET,
     .size = sizeof(NetSocketState),
     .receive = net_socket_receive_dgram,
     .cleanup = net_socket_cleanup,
+    .set_aio_context = net_socket_set_aio_context,
 };
 
 static NetSocketState *net_socket_fd_init_dgram(NetClientState *peer,
@@ -415,6 +463,7 @@ static NetClientInfo net_socket_info = {
     .size = sizeof(NetSocketState),
     .receive = net_socket_receive,
     .cleanup = net_socket_cleanup,
+    .set_aio_context = net_socket_set_aio_context,
 };
 
 static NetSocketState *net_socket_fd_init_stream(NetClientState *peer,
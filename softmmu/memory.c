@@ -40,6 +40,15 @@
 static unsigned memory_region_transaction_depth;
 static bool memory_region_update_pending;
 static bool ioeventfd_update_pending;
+
+/*
+ * Regions whose FlatView must be rendered again at the end of the current
+ * transaction: the ones that changed and their containers.  The pointers are
+ * only compared with FlatView roots, never dereferenced.  If a change may be
+ * visible through an alias, all FlatViews are rendered again instead.
+ */
+static GHashTable *flat_views_dirty;
+static bool flat_views_all_dirty;
 unsigned int global_dirty_tracking;
 
 static QTAILQ_HEAD(, MemoryListener) memory_listeners
@@ -1019,26 +1028,80 @@ static void flatviews_init(void)
     }
 }
 
+/*
+ * Note that the rendering of @mr changed, or of everything if @mr is NULL.
+ */
+static void memory_region_update_pending_add(MemoryRegion *mr)
+{
+    memory_region_update_pending = true;
+    if (!mr) {
+        flat_views_all_dirty = true;
+    }
+    if (flat_views_all_dirty) {
+        return;
+    }
+    if (!flat_views_dirty) {
+        flat_views_dirty = g_hash_table_new(NULL, NULL);
+    }
+
+    for (; mr; mr = mr->container) {
+        if (mr->mapped_via_alias) {
+            break;
+        }
+        g_hash_table_add(flat_views_dirty, mr);
+    }
+    if (mr) {
+        flat_views_all_dirty = true;
+    }
+}
+
+static bool flatview_is_dirty(MemoryRegion *physmr)
+{
+    /*
+     * An alias root is not a subregion of anything, so changes below its
+     * target don't show up in mapped_via_alias.
+     */
+    return flat_views_all_dirty || !physmr || physmr->alias ||
+           g_hash_table_contains(flat_views_dirty, physmr);
+}
+
 static void flatviews_reset(void)
 {
     AddressSpace *as;
+    GHashTable *old_views = flat_views;
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    flat_views = NULL;
     flatviews_init();
 
-    /* Render unique FVs */
+    /*
+     * Render unique FVs.  The ones that did not change are carried over, so
+     * the address spaces using them keep their FlatView and dispatch tree.
+     */
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
+        FlatView *view;
 
         if (g_hash_table_lookup(flat_views, physmr)) {
             continue;
         }
 
-        generate_memory_topology(physmr);
+        view = old_views && !flatview_is_dirty(physmr) ?
+               g_hash_table_lookup(old_views, physmr) : NULL;
+        if (view) {
+            flatview_ref(view);
+            g_hash_table_replace(flat_views, physmr, view);
+        } else {
+            generate_memory_topology(physmr);
+        }
     }
+
+    if (old_views) {
+        g_hash_table_unref(old_views);
+    }
+    if (flat_views_dirty) {
+        g_hash_table_remove_all(flat_views_dirty);
+    }
+    flat_views_all_dirty = false;
 }
 
 static void address_space_set_flatview(AddressSpace *as)
@@ -1086,6 +1149,36 @@ static void address_space_set_flatview(AddressSpace *as)
     }
 }
 
+static bool address_space_flatview_changed(AddressSpace *as)
+{
+    MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
+
+    return g_hash_table_lookup(flat_views, physmr) !=
+           address_space_to_flatview(as);
+}
+
+static void address_space_listeners_begin(AddressSpace *as)
+{
+    MemoryListener *listener;
+
+    QTAILQ_FOREACH(listener, &as->listeners, link_as) {
+        if (listener->begin) {
+            listener->begin(listener);
+        }
+    }
+}
+
+static void address_space_listeners_commit(AddressSpace *as)
+{
+    MemoryListener *listener;
+
+    QTAILQ_FOREACH(listener, &as->listeners, link_as) {
+        if (listener->commit) {
+            listener->commit(listener);
+        }
+    }
+}
+
 static void address_space_update_topology(AddressSpace *as)
 {
     MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
@@ -1115,15 +1208,26 @@ void memory_region_transaction_commit(void)
         if (memory_region_update_pending) {
             flatviews_reset();
 
-            MEMORY_LISTENER_CALL_GLOBAL(begin, Forward);
-
+            /*
+             * Only the listeners of address spaces that got a new FlatView
+             * hear about the transaction.  Listeners rebuild their state
+             * from the region_add/region_nop calls between begin and
+             * commit, so a begin/commit pair without them for an address
+             * space whose FlatView was reused would look like all of its
+             * memory was removed.
+             */
             QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
-                address_space_set_flatview(as);
-                address_space_update_ioeventfds(as);
+                if (address_space_flatview_changed(as)) {
+                    address_space_listeners_begin(as);
+                    address_space_set_flatview(as);
+                    address_space_listeners_commit(as);
+                    address_space_update_ioeventfds(as);
+                } else if (ioeventfd_update_pending) {
+                    address_space_update_ioeventfds(as);
+                }
             }
             memory_region_update_pending = false;
             ioeventfd_update_pending = false;
-            MEMORY_LISTENER_CALL_GLOBAL(commit, Forward);
         } else if (ioeventfd_update_pending) {
             QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
                 address_space_update_ioeventfds(as);
@@ -2239,7 +2343,9 @@ void memory_region_set_log(MemoryRegion *mr, bool log, unsigned client)
 
     memory_region_transaction_begin();
     mr->dirty_log_mask = (mr->dirty_log_mask & ~mask) | (log * mask);
-    memory_region_update_pending |= mr->enabled;
+    if (mr->enabled) {
+        memory_region_update_pending_add(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2369,7 +2475,9 @@ void memory_region_set_readonly(MemoryRegion *mr, bool readonly)
     if (mr->readonly != readonly) {
         memory_region_transaction_begin();
         mr->readonly = readonly;
-        memory_region_update_pending |= mr->enabled;
+        if (mr->enabled) {
+            memory_region_update_pending_add(mr);
+        }
         memory_region_transaction_commit();
     }
 }
@@ -2379,7 +2487,9 @@ void memory_region_set_nonvolatile(MemoryRegion *mr, bool nonvolatile)
     if (mr->nonvolatile != nonvolatile) {
         memory_region_transaction_begin();
         mr->nonvolatile = nonvolatile;
-        memory_region_update_pending |= mr->enabled;
+        if (mr->enabled) {
+            memory_region_update_pending_add(mr);
+        }
         memory_region_transaction_commit();
     }
 }
@@ -2389,7 +2499,9 @@ void memory_region_rom_device_set_romd(MemoryRegion *mr, bool romd_mode)
     if (mr->romd_mode != romd_mode) {
         memory_region_transaction_begin();
         mr->romd_mode = romd_mode;
-        memory_region_update_pending |= mr->enabled;
+        if (mr->enabled) {
+            memory_region_update_pending_add(mr);
+        }
         memory_region_transaction_commit();
     }
 }
@@ -2539,6 +2651,12 @@ void memory_region_clear_flush_coalesced(MemoryRegion *mr)
     }
 }
 
+void memory_region_enable_lockless_io(MemoryRegion *mr)
+{
+    mr->lockless_io = true;
+    mr->disable_reentrancy_guard = true;
+}
+
 static bool userspace_eventfd_warning;
 
 void memory_region_add_eventfd(MemoryRegion *mr,
@@ -2634,7 +2752,9 @@ static void memory_region_update_container_subregions(MemoryRegion *subregion)
     }
     QTAILQ_INSERT_TAIL(&mr->subregions, subregion, subregions_link);
 done:
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
+    if (mr->enabled && subregion->enabled) {
+        memory_region_update_pending_add(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2684,7 +2804,9 @@ void memory_region_del_subregion(MemoryRegion *mr,
     }
     QTAILQ_REMOVE(&mr->subregions, subregion, subregions_link);
     memory_region_unref(subregion);
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
+    if (mr->enabled && subregion->enabled) {
+        memory_region_update_pending_add(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2695,7 +2817,7 @@ void memory_region_set_enabled(MemoryRegion *mr, bool enabled)
     }
     memory_region_transaction_begin();
     mr->enabled = enabled;
-    memory_region_update_pending = true;
+    memory_region_update_pending_add(mr);
     memory_region_transaction_commit();
 }
 
@@ -2711,7 +2833,7 @@ void memory_region_set_size(MemoryRegion *mr, uint64_t size)
     }
     memory_region_transaction_begin();
     mr->size = s;
-    memory_region_update_pending = true;
+    memory_region_update_pending_add(mr);
     memory_region_transaction_commit();
 }
 
@@ -2747,7 +2869,9 @@ void memory_region_set_alias_offset(MemoryRegion *mr, hwaddr offset)
 
     memory_region_transaction_begin();
     mr->alias_offset = offset;
-    memory_region_update_pending |= mr->enabled;
+    if (mr->enabled) {
+        memory_region_update_pending_add(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2918,7 +3042,7 @@ void memory_global_dirty_log_start(unsigned int flags)
     if (!old_flags) {
         MEMORY_LISTENER_CALL_GLOBAL(log_global_start, Forward);
         memory_region_transaction_begin();
-        memory_region_update_pending = true;
+        memory_region_update_pending_add(NULL);
         memory_region_transaction_commit();
     }
 }
@@ -2933,7 +3057,7 @@ static void memory_global_dirty_log_do_stop(unsigned int flags)
 
     if (!global_dirty_tracking) {
         memory_region_transaction_begin();
-        memory_region_update_pending = true;
+        memory_region_update_pending_add(NULL);
         memory_region_transaction_commit();
         MEMORY_LISTENER_CALL_GLOBAL(log_global_stop, Reverse);
     }
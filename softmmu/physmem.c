@@ -129,6 +129,8 @@ typedef struct PhysPageMap {
 
 struct AddressSpaceDispatch {
     MemoryRegionSection *mru_section;
+    /* Unique across all dispatches, keys the per-CPU dispatch caches */
+    uint64_t gen;
     /* This is a multi-level map on the physical address space.
      * The bottom level has pointers to MemoryRegionSections.
      */
@@ -333,17 +335,57 @@ static MemoryRegionSection *phys_page_find(AddressSpaceDispatch *d, hwaddr addr)
 }
 
 /* Called from RCU critical section */
+static inline bool section_cacheable(AddressSpaceDispatch *d,
+                                     MemoryRegionSection *section, hwaddr addr)
+{
+    return section && section != &d->map.sections[PHYS_SECTION_UNASSIGNED] &&
+           section_covers_addr(section, addr);
+}
+
+/*
+ * vCPUs look up sections in a small cache of their own, so that MMIO
+ * heavy loops of different vCPUs against different devices neither
+ * thrash nor bounce the cache line of the shared MRU section.  Entries
+ * are keyed by the generation of the dispatch, which (unlike its address)
+ * is never reused once the FlatView went away.
+ */
+static MemoryRegionSection *cpu_dispatch_cache_lookup(CPUState *cpu,
+                                                      AddressSpaceDispatch *d,
+                                                      hwaddr addr)
+{
+    CPUDispatchCacheEntry *e;
+    int i;
+
+    for (i = 0; i < CPU_DISPATCH_CACHE_SIZE; i++) {
+        e = &cpu->dispatch_cache[i];
+        if (e->gen == d->gen && section_covers_addr(e->section, addr)) {
+            return e->section;
+        }
+    }
+
+    e = &cpu->dispatch_cache[cpu->dispatch_cache_next];
+    cpu->dispatch_cache_next = (cpu->dispatch_cache_next + 1) %
+                               CPU_DISPATCH_CACHE_SIZE;
+    e->section = phys_page_find(d, addr);
+    e->gen = section_cacheable(d, e->section, addr) ? d->gen : 0;
+    return e->section;
+}
+
 static MemoryRegionSection *address_space_lookup_region(AddressSpaceDispatch *d,
                                                         hwaddr addr,
                                                         bool resolve_subpage)
 {
-    MemoryRegionSection *section = qatomic_read(&d->mru_section);
+    MemoryRegionSection *section;
     subpage_t *subpage;
 
-    if (!section || section == &d->map.sections[PHYS_SECTION_UNASSIGNED] ||
-        !section_covers_addr(section, addr)) {
-        section = phys_page_find(d, addr);
-        qatomic_set(&d->mru_section, section);
+    if (current_cpu) {
+        section = cpu_dispatch_cache_lookup(current_cpu, d, addr);
+    } else {
+        section = qatomic_read(&d->mru_section);
+        if (!section_cacheable(d, section, addr)) {
+            section = phys_page_find(d, addr);
+            qatomic_set(&d->mru_section, section);
+        }
     }
     if (resolve_subpage && section->mr->subpage) {
         subpage = container_of(section->mr, subpage_t, iomem);
@@ -2426,12 +2468,16 @@ static void io_mem_init(void)
 
 AddressSpaceDispatch *address_space_dispatch_new(FlatView *fv)
 {
+    static uint64_t dispatch_gen;
     AddressSpaceDispatch *d = g_new0(AddressSpaceDispatch, 1);
     uint16_t n;
 
     n = dummy_section(&d->map, fv, &io_mem_unassigned);
     assert(n == PHYS_SECTION_UNASSIGNED);
 
+    /* FlatViews are only generated with the BQL held */
+    d->gen = ++dispatch_gen;
+
     d->phys_map  = (PhysPageEntry) { .ptr = PHYS_MAP_NODE_NIL, .skip = 1 };
 
     return d;
@@ -2589,7 +2635,8 @@ bool prepare_mmio_access(MemoryRegion *mr)
 {
     bool release_lock = false;
 
-    if (!qemu_mutex_iothread_locked()) {
+    if ((!mr->lockless_io || mr->flush_coalesced_mmio) &&
+        !qemu_mutex_iothread_locked()) {
         qemu_mutex_lock_iothread();
         release_lock = true;
     }
@@ -2593,6 +2593,12 @@ static void qemu_machine_creation_done(void)
 {
     MachineState *machine = MACHINE(qdev_get_machine());
 
+    /*
+     * Memory backends preallocate in the background while the board and
+     * devices are created; wait for that before anything else runs.
+     */
+    qemu_finish_async_prealloc_mem(&error_fatal);
+
     /* Did we create any drives that we failed to create a device for? */
     drive_check_orphaned();
 
@@ -4152,6 +4152,53 @@ static void tcg_reg_free(TCGContext *s, TCGReg reg, TCGRegSet allocated_regs)
     }
 }
 
+/*
+ * Register @reg is about to be clobbered by a call.  If the temp it holds
+ * is live across the call, try to move it to a free call-saved register,
+ * rather than storing it now and loading it again after the call.
+ * Globals are only worth moving if the helper cannot write them.
+ * Return true if the temp was moved.
+ */
+static bool tcg_reg_move_across_call(TCGContext *s, TCGReg reg,
+                                     TCGRegSet allocated_regs,
+                                     bool keep_globals)
+{
+    TCGTemp *ts = s->reg_to_temp[reg];
+    TCGRegSet set;
+    int i;
+
+    switch (ts->kind) {
+    case TEMP_GLOBAL:
+        if (!keep_globals) {
+            return false;
+        }
+        break;
+    case TEMP_TB:
+    case TEMP_EBB:
+        break;
+    default:
+        return false;
+    }
+
+    set = tcg_target_available_regs[ts->type] & ~tcg_target_call_clobber_regs;
+    set &= ~(allocated_regs | s->reserved_regs);
+    if (set == 0) {
+        return false;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(tcg_target_reg_alloc_order); i++) {
+        TCGReg r = tcg_target_reg_alloc_order[i];
+        if (tcg_regset_test_reg(set, r) && s->reg_to_temp[r] == NULL) {
+            if (!tcg_out_mov(s, ts->type, r, reg)) {
+                return false;
+            }
+            set_temp_val_reg(s, ts, r);
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * tcg_reg_alloc:
  * @required_regs: Set of registers in which we must allocate.
@@ -5175,6 +5222,7 @@ static void tcg_reg_alloc_call(TCGContext *s, TCGOp *op)
     const TCGLifeData arg_life = op->life;
     const TCGHelperInfo *info = tcg_call_info(op);
     TCGRegSet allocated_regs = s->reserved_regs;
+    bool keep_globals;
     int i;
 
     /*
@@ -5212,9 +5260,16 @@ static void tcg_reg_alloc_call(TCGContext *s, TCGOp *op)
         }
     }
 
-    /* Clobber call registers.  */
+    /*
+     * Clobber call registers, keeping temps that survive the call
+     * in call-saved registers where possible.
+     */
+    keep_globals = info->flags & (TCG_CALL_NO_READ_GLOBALS |
+                                  TCG_CALL_NO_WRITE_GLOBALS);
     for (i = 0; i < TCG_TARGET_NB_REGS; i++) {
-        if (tcg_regset_test_reg(tcg_target_call_clobber_regs, i)) {
+        if (tcg_regset_test_reg(tcg_target_call_clobber_regs, i) &&
+            s->reg_to_temp[i] != NULL &&
+            !tcg_reg_move_across_call(s, i, allocated_regs, keep_globals)) {
             tcg_reg_free(s, i, allocated_regs);
         }
     }
@@ -24,10 +24,12 @@
 #include "libqos/libqos.h"
 #include "libqos/pci-pc.h"
 #include "libqos/virtio-pci.h"
+#include "libqos/virtio-net.h"
 
 #include "libqos/malloc-pc.h"
 #include "libqos/qgraph_internal.h"
 #include "hw/virtio/virtio-net.h"
+#include "hw/pci/pci_regs.h"
 
 #include "standard-headers/linux/vhost_types.h"
 #include "standard-headers/linux/virtio_ids.h"
@@ -156,6 +158,7 @@ typedef struct TestServer {
     int fds_num;
     int fds[VHOST_MEMORY_MAX_NREGIONS];
     VhostUserMemory memory;
+    int mem_table_count;
     GMainContext *context;
     GMainLoop *loop;
     GThread *thread;
@@ -448,6 +451,7 @@ static void chr_read(void *opaque, const uint8_t *buf, int size)
         memcpy(&s->memory, &msg.payload.memory, sizeof(msg.payload.memory));
         s->fds_num = qemu_chr_fe_get_msgfds(chr, s->fds,
                                             G_N_ELEMENTS(s->fds));
+        s->mem_table_count++;
 
         /* signal the test that it can continue */
         g_cond_broadcast(&s->data_cond);
@@ -797,6 +801,59 @@ static void test_read_guest_mem(void *obj, void *arg, QGuestAllocator *alloc)
     read_guest_mem_server(global_qtest, server);
 }
 
+/*
+ * Toggling bus mastering of another PCI device only changes that device's
+ * address space.  The FlatView of system memory is reused, and the vhost
+ * backend must keep its memory table.
+ */
+static void test_unrelated_memory_update(void *obj, void *arg,
+                                         QGuestAllocator *alloc)
+{
+    QVirtioNetPCI *net = obj;
+    QPCIDevice *pdev = net->pci_vdev.pdev;
+    TestServer *server = arg;
+    QPCIDevice *other;
+    gint64 end_time;
+    uint16_t cmd;
+    int count;
+
+    if (!wait_for_fds(server)) {
+        return;
+    }
+
+    other = qpci_device_find(pdev->bus, 0);
+    if (!other || other->devfn == pdev->devfn) {
+        g_free(other);
+        g_test_skip("No other PCI device at devfn 0");
+        return;
+    }
+
+    g_mutex_lock(&server->data_mutex);
+    count = server->mem_table_count;
+    g_mutex_unlock(&server->data_mutex);
+
+    cmd = qpci_config_readw(other, PCI_COMMAND);
+    qpci_config_writew(other, PCI_COMMAND, cmd ^ PCI_COMMAND_MASTER);
+    qpci_config_writew(other, PCI_COMMAND, cmd);
+    g_free(other);
+
+    /*
+     * An update would be sent before the config writes complete, so a
+     * short wait is enough for the server to receive it.
+     */
+    g_mutex_lock(&server->data_mutex);
+    end_time = g_get_monotonic_time() + 100 * G_TIME_SPAN_MILLISECOND;
+    while (server->mem_table_count == count &&
+           g_cond_wait_until(&server->data_cond, &server->data_mutex,
+                             end_time)) {
+        /* keep waiting */
+    }
+    g_assert_cmpint(server->mem_table_count, ==, count);
+    g_mutex_unlock(&server->data_mutex);
+
+    read_guest_mem_server(global_qtest, server);
+}
+
 static void test_migrate(void *obj, void *arg, QGuestAllocator *alloc)
 {
     TestServer *s = arg;
@@ -1086,6 +1143,10 @@ static void register_vhost_user_test(void)
                      test_read_guest_mem, &opts);
     }
 
+    qos_add_test("vhost-user/unrelated-memory-update",
+                 "virtio-net-pci",
+                 test_unrelated_memory_update, &opts);
+
     qos_add_test("vhost-user/migrate",
                  "virtio-net",
                  test_migrate, &opts);
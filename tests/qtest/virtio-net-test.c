@@ -155,6 +155,13 @@ static void send_recv_test(void *obj, void *data, QGuestAllocator *t_alloc)
     tx_test(dev, t_alloc, tx, sv[0]);
 }
 
+static void iothread_test(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioNetPCI *dev = obj;
+
+    send_recv_test(&dev->net, data, t_alloc);
+}
+
 static void stop_cont_test(void *obj, void *data, QGuestAllocator *t_alloc)
 {
     QVirtioNet *net_if = obj;
@@ -284,6 +291,46 @@ static void *virtio_net_test_setup(GString *cmd_line, void *arg)
     return sv;
 }
 
+/*
+ * The "iothreads" list can only be given with JSON syntax, so turn the
+ * virtio-net-pci options built by qos into a JSON -device argument.
+ */
+static void *virtio_net_test_setup_iothread(GString *cmd_line, void *arg)
+{
+    const char *device = "-device virtio-net-pci,";
+    const char *start = strstr(cmd_line->str, device);
+    const char *opts, *end;
+    g_autofree char *device_opts = NULL;
+    g_auto(GStrv) props = NULL;
+    g_autoptr(GString) json = g_string_new("-device '{\"driver\": "
+                                           "\"virtio-net-pci\"");
+    gssize pos;
+    int i;
+
+    g_assert(start);
+    pos = start - cmd_line->str;
+    opts = start + strlen(device);
+    end = strchr(opts, ' ');
+    if (!end) {
+        end = opts + strlen(opts);
+    }
+    device_opts = g_strndup(opts, end - opts);
+    props = g_strsplit(device_opts, ",", -1);
+    for (i = 0; props[i]; i++) {
+        g_auto(GStrv) kv = g_strsplit(props[i], "=", 2);
+
+        g_assert(kv[0] && kv[1]);
+        g_string_append_printf(json, ", \"%s\": \"%s\"", kv[0], kv[1]);
+    }
+    g_string_append(json, ", \"iothreads\": [\"io0\"]}'");
+
+    g_string_erase(cmd_line, pos, end - start);
+    g_string_insert(cmd_line, pos, json->str);
+    g_string_append(cmd_line, " -object iothread,id=io0 ");
+
+    return virtio_net_test_setup(cmd_line, arg);
+}
+
 #endif /* _WIN32 */
 
 static void large_tx(void *obj, void *data, QGuestAllocator *t_alloc)
@@ -327,6 +374,9 @@ static void register_virtio_net_test(void)
     qos_add_test("basic", "virtio-net", send_recv_test, &opts);
     qos_add_test("rx_stop_cont", "virtio-net", stop_cont_test, &opts);
     qos_add_test("announce-self", "virtio-net", announce_self, &opts);
+
+    opts.before = virtio_net_test_setup_iothread;
+    qos_add_test("iothread", "virtio-net-pci", iothread_test, &opts);
 #endif
 
     /* These tests do not need a loopback backend.  */
@@ -0,0 +1,105 @@
+/*
+ * Toeplitz hash unit tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "net/checksum.h"
+
+/* Key and vectors from the Microsoft RSS hash verification suite */
+static const uint8_t rss_key[NET_TOEPLITZ_KEY_SIZE] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+static uint32_t toeplitz_reference(const uint8_t *key, const uint8_t *input,
+                                   uint32_t len)
+{
+    uint8_t key_bytes[NET_TOEPLITZ_KEY_SIZE];
+    net_toeplitz_key tkey;
+    uint32_t result = 0;
+
+    memcpy(key_bytes, key, sizeof(key_bytes));
+    net_toeplitz_key_init(&tkey, key_bytes);
+    net_toeplitz_add(&result, (uint8_t *)input, len, &tkey);
+    return result;
+}
+
+static void test_toeplitz_known_vectors(void)
+{
+    /* 66.9.149.187:2794 -> 161.142.100.80:1766 */
+    const uint8_t input[] = {
+        66, 9, 149, 187, 161, 142, 100, 80, 0x0a, 0xea, 0x06, 0xe6,
+    };
+    NetToeplitzTable *t = g_new(NetToeplitzTable, 1);
+
+    net_toeplitz_table_init(t, rss_key);
+    g_assert(!memcmp(t->key, rss_key, sizeof(rss_key)));
+
+    g_assert_cmphex(toeplitz_reference(rss_key, input, 8), ==, 0x323e8fc2);
+    g_assert_cmphex(net_toeplitz_table_hash(t, input, 8), ==, 0x323e8fc2);
+    g_assert_cmphex(toeplitz_reference(rss_key, input, 12), ==, 0x51ccc178);
+    g_assert_cmphex(net_toeplitz_table_hash(t, input, 12), ==, 0x51ccc178);
+
+    g_free(t);
+}
+
+static void test_toeplitz_random(void)
+{
+    NetToeplitzTable *t = g_new(NetToeplitzTable, 1);
+    uint8_t key[NET_TOEPLITZ_KEY_SIZE];
+    uint8_t input[NET_TOEPLITZ_MAX_INPUT];
+    int i, j, len;
+
+    for (i = 0; i < 16; i++) {
+        for (j = 0; j < sizeof(key); j++) {
+            key[j] = g_test_rand_int_range(0, 256);
+        }
+        net_toeplitz_table_init(t, key);
+
+        for (len = 0; len <= NET_TOEPLITZ_MAX_INPUT; len++) {
+            for (j = 0; j < len; j++) {
+                input[j] = g_test_rand_int_range(0, 256);
+            }
+            g_assert_cmphex(net_toeplitz_table_hash(t, input, len), ==,
+                            toeplitz_reference(key, input, len));
+        }
+    }
+
+    g_free(t);
+}
+
+static void test_toeplitz_table_entries(void)
+{
+    NetToeplitzTable *t = g_new(NetToeplitzTable, 1);
+    uint8_t input[NET_TOEPLITZ_MAX_INPUT] = { 0 };
+    int pos, v;
+
+    /* Hash each value at each position on its own to check every entry */
+    net_toeplitz_table_init(t, rss_key);
+    for (pos = 0; pos < NET_TOEPLITZ_MAX_INPUT; pos++) {
+        for (v = 0; v < 256; v++) {
+            input[pos] = v;
+            g_assert_cmphex(net_toeplitz_table_hash(t, input, pos + 1), ==,
+                            toeplitz_reference(rss_key, input, pos + 1));
+        }
+        input[pos] = 0;
+    }
+
+    g_free(t);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/net/toeplitz/known-vectors", test_toeplitz_known_vectors);
+    g_test_add_func("/net/toeplitz/table-entries",
+                    test_toeplitz_table_entries);
+    g_test_add_func("/net/toeplitz/random", test_toeplitz_random);
+    return g_test_run();
+}
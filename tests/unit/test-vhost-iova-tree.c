@@ -0,0 +1,112 @@
+/*
+ * vhost iova tree unit tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/virtio/vhost-iova-tree.h"
+
+/* DMAMap sizes are inclusive */
+static DMAMap test_map(hwaddr translated_addr, hwaddr size)
+{
+    return (DMAMap) {
+        .translated_addr = translated_addr,
+        .size = size - 1,
+        .perm = IOMMU_RW,
+    };
+}
+
+static const DMAMap *test_alloc(VhostIOVATree *tree, hwaddr translated_addr,
+                                hwaddr size)
+{
+    DMAMap map = test_map(translated_addr, size);
+    const DMAMap *found;
+
+    g_assert_cmpint(vhost_iova_tree_map_alloc(tree, &map), ==, IOVA_OK);
+    found = vhost_iova_tree_find_iova(tree, &map);
+    g_assert(found);
+    g_assert_cmphex(found->iova, ==, map.iova);
+    return found;
+}
+
+static void test_find_cached_hit(void)
+{
+    g_autoptr(VhostIOVATree) tree = vhost_iova_tree_new(0, UINT32_MAX);
+    const DMAMap *a = test_alloc(tree, 0x10000, 0x1000);
+    const DMAMap *b = test_alloc(tree, 0x20000, 0x1000);
+    DMAMap needle;
+
+    needle = test_map(0x10100, 0x100);
+    g_assert(vhost_iova_tree_find_iova_cached(tree, &needle) == a);
+    needle = test_map(0x20000, 0x1000);
+    g_assert(vhost_iova_tree_find_iova_cached(tree, &needle) == b);
+
+    /* Both are cached now, and hits still return the containing map */
+    needle = test_map(0x10000, 0x1000);
+    g_assert(vhost_iova_tree_find_iova_cached(tree, &needle) == a);
+    needle = test_map(0x20fff, 1);
+    g_assert(vhost_iova_tree_find_iova_cached(tree, &needle) == b);
+    needle = test_map(0x30000, 0x100);
+    g_assert(!vhost_iova_tree_find_iova_cached(tree, &needle));
+}
+
+static void test_find_cached_partial(void)
+{
+    g_autoptr(VhostIOVATree) tree = vhost_iova_tree_new(0, UINT32_MAX);
+    /* b gets the lower iova, so the tree finds it before a */
+    const DMAMap *b = test_alloc(tree, 0x11000, 0x1000);
+    const DMAMap *a = test_alloc(tree, 0x10000, 0x1000);
+    DMAMap needle;
+
+    g_assert_cmphex(b->iova, <, a->iova);
+
+    needle = test_map(0x10000, 0x100);
+    g_assert(vhost_iova_tree_find_iova_cached(tree, &needle) == a);
+
+    /* a only contains the start of the range, so it must not be used */
+    needle = test_map(0x10f00, 0x200);
+    g_assert(vhost_iova_tree_find_iova(tree, &needle) == b);
+    g_assert(vhost_iova_tree_find_iova_cached(tree, &needle) == b);
+
+    /* A range that a does contain still hits */
+    needle = test_map(0x10f00, 0x100);
+    g_assert(vhost_iova_tree_find_iova_cached(tree, &needle) == a);
+}
+
+static void test_find_cached_remove(void)
+{
+    g_autoptr(VhostIOVATree) tree = vhost_iova_tree_new(0, UINT32_MAX);
+    const DMAMap *a = test_alloc(tree, 0x10000, 0x1000);
+    const DMAMap *b = test_alloc(tree, 0x20000, 0x1000);
+    DMAMap needle, removed = *a;
+
+    needle = test_map(0x10100, 0x100);
+    g_assert(vhost_iova_tree_find_iova_cached(tree, &needle) == a);
+    needle = test_map(0x20100, 0x100);
+    g_assert(vhost_iova_tree_find_iova_cached(tree, &needle) == b);
+
+    /* a is freed by the removal and must not be returned anymore */
+    vhost_iova_tree_remove(tree, removed);
+    needle = test_map(0x10100, 0x100);
+    g_assert(!vhost_iova_tree_find_iova_cached(tree, &needle));
+    needle = test_map(0x20100, 0x100);
+    g_assert(vhost_iova_tree_find_iova_cached(tree, &needle) == b);
+
+    /* A new mapping of the same memory is found instead */
+    a = test_alloc(tree, 0x10000, 0x1000);
+    needle = test_map(0x10100, 0x100);
+    g_assert(vhost_iova_tree_find_iova_cached(tree, &needle) == a);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/vhost-iova-tree/find-cached/hit", test_find_cached_hit);
+    g_test_add_func("/vhost-iova-tree/find-cached/partial",
+                    test_find_cached_partial);
+    g_test_add_func("/vhost-iova-tree/find-cached/remove",
+                    test_find_cached_remove);
+    return g_test_run();
+}
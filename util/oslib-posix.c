@@ -38,9 +38,11 @@
 #include "qemu/madvise.h"
 #include "qemu/sockets.h"
 #include "qemu/thread.h"
+#include "qemu/queue.h"
 #include <libgen.h>
 #include "qemu/cutils.h"
 #include "qemu/units.h"
+#include "qemu/host-utils.h"
 #include "qemu/thread-context.h"
 
 #ifdef CONFIG_LINUX
@@ -61,6 +63,14 @@
 
 #define MAX_MEM_PREALLOC_THREAD_COUNT 16
 
+/*
+ * Threads preallocate in chunks of this size, grabbing the next chunk once
+ * they are done with the current one. This balances the load between
+ * threads that make progress at different speeds (e.g., because they run
+ * on different host NUMA nodes) and allows for reporting progress.
+ */
+#define MEMSET_CHUNK_SIZE (256 * MiB)
+
 struct MemsetThread;
 
 typedef struct MemsetContext {
@@ -68,18 +78,33 @@ typedef struct MemsetContext {
     bool any_thread_failed;
     struct MemsetThread *threads;
     int num_threads;
+    bool use_madv_populate_write;
+    bool collapse;
+    /* Name of the memory for error messages, or NULL */
+    char *name;
+    char *area;
+    size_t hpagesize;
+    size_t numpages;
+    size_t chunkpages;
+    /* Next page to hand out, atomic. */
+    size_t next_page;
+    /* Number of pages preallocated so far, atomic. */
+    size_t done_pages;
+    int64_t start_us;
+    QLIST_ENTRY(MemsetContext) next;
 } MemsetContext;
 
 struct MemsetThread {
-    char *addr;
-    size_t numpages;
-    size_t hpagesize;
     QemuThread pgthread;
     sigjmp_buf env;
     MemsetContext *context;
 };
 typedef struct MemsetThread MemsetThread;
 
+/* Asynchronous preallocations not waited for yet, protected by the BQL. */
+static QLIST_HEAD(, MemsetContext) memset_contexts =
+    QLIST_HEAD_INITIALIZER(memset_contexts);
+
 /* used by sigbus_handler() */
 static MemsetContext *sigbus_memset_context;
 struct sigaction sigbus_oldact;
@@ -327,22 +352,55 @@ static void sigbus_handler(int signal)
     warn_report("qemu_prealloc_mem: unrelated SIGBUS detected and ignored");
 }
 
-static void *do_touch_pages(void *arg)
+static void wait_all_threads_created(MemsetContext *context)
 {
-    MemsetThread *memset_args = (MemsetThread *)arg;
-    sigset_t set, oldset;
-    int ret = 0;
-
     /*
      * On Linux, the page faults from the loop below can cause mmap_sem
      * contention with allocation of the thread stacks.  Do not start
      * clearing until all threads have been created.
      */
     qemu_mutex_lock(&page_mutex);
-    while (!memset_args->context->all_threads_created) {
+    while (!context->all_threads_created) {
         qemu_cond_wait(&page_cond, &page_mutex);
     }
     qemu_mutex_unlock(&page_mutex);
+}
+
+static bool memset_next_chunk(MemsetContext *context, char **addr,
+                              size_t *numpages)
+{
+    size_t page;
+
+    if (qatomic_read(&context->any_thread_failed)) {
+        return false;
+    }
+    page = qatomic_fetch_add(&context->next_page, context->chunkpages);
+    if (page >= context->numpages) {
+        return false;
+    }
+    *addr = context->area + page * context->hpagesize;
+    *numpages = MIN(context->chunkpages, context->numpages - page);
+    return true;
+}
+
+static void memset_chunk_done(MemsetContext *context, size_t numpages)
+{
+    size_t done = qatomic_add_fetch(&context->done_pages, numpages);
+
+    trace_qemu_prealloc_mem_progress(context->area,
+                                     done * context->hpagesize,
+                                     context->numpages * context->hpagesize);
+}
+
+static void *do_touch_pages(void *arg)
+{
+    MemsetThread *memset_args = (MemsetThread *)arg;
+    MemsetContext *context = memset_args->context;
+    const size_t hpagesize = context->hpagesize;
+    sigset_t set, oldset;
+    int ret = 0;
+
+    wait_all_threads_created(context);
 
     /* unblock SIGBUS */
     sigemptyset(&set);
@@ -350,45 +408,66 @@ static void *do_touch_pages(void *arg)
     pthread_sigmask(SIG_UNBLOCK, &set, &oldset);
 
     if (sigsetjmp(memset_args->env, 1)) {
+        qatomic_set(&context->any_thread_failed, true);
         ret = -EFAULT;
     } else {
-        char *addr = memset_args->addr;
-        size_t numpages = memset_args->numpages;
-        size_t hpagesize = memset_args->hpagesize;
-        size_t i;
-        for (i = 0; i < numpages; i++) {
-            /*
-             * Read & write back the same value, so we don't
-             * corrupt existing user/app data that might be
-             * stored.
-             *
-             * 'volatile' to stop compiler optimizing this away
-             * to a no-op
-             */
-            *(volatile char *)addr = *addr;
-            addr += hpagesize;
+        size_t numpages, i;
+        char *addr;
+
+        while (memset_next_chunk(context, &addr, &numpages)) {
+            for (i = 0; i < numpages; i++) {
+                /*
+                 * Read & write back the same value, so we don't
+                 * corrupt existing user/app data that might be
+                 * stored.
+                 *
+                 * 'volatile' to stop compiler optimizing this away
+                 * to a no-op
+                 */
+                *(volatile char *)addr = *addr;
+                addr += hpagesize;
+            }
+            memset_chunk_done(context, numpages);
         }
     }
     pthread_sigmask(SIG_SETMASK, &oldset, NULL);
     return (void *)(uintptr_t)ret;
 }
 
+/*
+ * Best effort: collapse freshly populated memory into transparent huge pages
+ * wherever the fault path had to fall back to small pages, e.g., due to
+ * fragmentation. Failing to do so is not fatal.
+ */
+static void collapse_pages(char *addr, size_t len)
+{
+    if (qemu_madvise(addr, len, QEMU_MADV_COLLAPSE)) {
+        trace_qemu_prealloc_mem_collapse_failed(addr, len, errno);
+    }
+}
+
 static void *do_madv_populate_write_pages(void *arg)
 {
     MemsetThread *memset_args = (MemsetThread *)arg;
-    const size_t size = memset_args->numpages * memset_args->hpagesize;
-    char * const addr = memset_args->addr;
+    MemsetContext *context = memset_args->context;
+    size_t numpages;
+    char *addr;
     int ret = 0;
 
     /* See do_touch_pages(). */
-    qemu_mutex_lock(&page_mutex);
-    while (!memset_args->context->all_threads_created) {
-        qemu_cond_wait(&page_cond, &page_mutex);
-    }
-    qemu_mutex_unlock(&page_mutex);
+    wait_all_threads_created(context);
 
-    if (size && qemu_madvise(addr, size, QEMU_MADV_POPULATE_WRITE)) {
-        ret = -errno;
+    while (memset_next_chunk(context, &addr, &numpages)) {
+        if (qemu_madvise(addr, numpages * context->hpagesize,
+                         QEMU_MADV_POPULATE_WRITE)) {
+            qatomic_set(&context->any_thread_failed, true);
+            ret = -errno;
+            break;
+        }
+        if (context->collapse) {
+            collapse_pages(addr, numpages * context->hpagesize);
+        }
+        memset_chunk_done(context, numpages);
     }
     return (void *)(uintptr_t)ret;
 }
@@ -412,18 +491,51 @@ static inline int get_memset_num_threads(size_t hpagesize, size_t numpages,
     return ret;
 }
 
+static int wait_and_free_mem_prealloc_context(MemsetContext *context)
+{
+    int i, ret = 0;
+
+    for (i = 0; i < context->num_threads; i++) {
+        int tmp = (uintptr_t)qemu_thread_join(&context->threads[i].pgthread);
+
+        if (tmp) {
+            ret = tmp;
+        }
+    }
+
+    if (sigbus_memset_context == context) {
+        sigbus_memset_context = NULL;
+    }
+    trace_qemu_prealloc_mem_done(context->area,
+                                 context->numpages * context->hpagesize, ret,
+                                 (g_get_monotonic_time() - context->start_us) /
+                                 1000);
+    g_free(context->threads);
+    g_free(context->name);
+    g_free(context);
+    return ret;
+}
+
+/* Describe the memory of @context for error messages. */
+static char *memset_context_describe(MemsetContext *context)
+{
+    if (context->name) {
+        return g_strdup_printf("of '%s'", context->name);
+    }
+    return g_strdup_printf("at %p (size 0x%zx)", context->area,
+                           context->numpages * context->hpagesize);
+}
+
 static int touch_all_pages(char *area, size_t hpagesize, size_t numpages,
-                           int max_threads, ThreadContext *tc,
-                           bool use_madv_populate_write)
+                           const QemuPreallocOptions *opts, bool async,
+                           bool use_madv_populate_write, bool collapse)
 {
     static gsize initialized = 0;
-    MemsetContext context = {
-        .num_threads = get_memset_num_threads(hpagesize, numpages, max_threads),
-    };
-    size_t numpages_per_thread, leftover;
+    int num_threads = get_memset_num_threads(hpagesize, numpages,
+                                             opts->max_threads);
+    MemsetContext *context;
     void *(*touch_fn)(void *);
-    int ret = 0, i = 0;
-    char *addr = area;
+    int i;
 
     if (g_once_init_enter(&initialized)) {
         qemu_mutex_init(&page_mutex);
@@ -431,13 +543,22 @@ static int touch_all_pages(char *area, size_t hpagesize, size_t numpages,
         g_once_init_leave(&initialized, 1);
     }
 
+    trace_qemu_prealloc_mem_start(area, hpagesize * numpages, num_threads,
+                                  async);
+
     if (use_madv_populate_write) {
-        /* Avoid creating a single thread for MADV_POPULATE_WRITE */
-        if (context.num_threads == 1) {
+        /*
+         * Avoid creating a single thread for MADV_POPULATE_WRITE when
+         * preallocating synchronously.
+         */
+        if (num_threads == 1 && !async) {
             if (qemu_madvise(area, hpagesize * numpages,
                              QEMU_MADV_POPULATE_WRITE)) {
                 return -errno;
             }
+            if (collapse) {
+                collapse_pages(area, hpagesize * numpages);
+            }
             return 0;
         }
         touch_fn = do_madv_populate_write_pages;
@@ -445,50 +566,79 @@ static int touch_all_pages(char *area, size_t hpagesize, size_t numpages,
         touch_fn = do_touch_pages;
     }
 
-    context.threads = g_new0(MemsetThread, context.num_threads);
-    numpages_per_thread = numpages / context.num_threads;
-    leftover = numpages % context.num_threads;
-    for (i = 0; i < context.num_threads; i++) {
-        context.threads[i].addr = addr;
-        context.threads[i].numpages = numpages_per_thread + (i < leftover);
-        context.threads[i].hpagesize = hpagesize;
-        context.threads[i].context = &context;
-        if (tc) {
-            thread_context_create_thread(tc, &context.threads[i].pgthread,
+    context = g_new0(MemsetContext, 1);
+    context->num_threads = num_threads;
+    context->use_madv_populate_write = use_madv_populate_write;
+    context->collapse = collapse;
+    context->name = g_strdup(opts->name);
+    context->area = area;
+    context->hpagesize = hpagesize;
+    context->numpages = numpages;
+    context->chunkpages = MAX(1, MEMSET_CHUNK_SIZE / hpagesize);
+    context->start_us = g_get_monotonic_time();
+
+    context->threads = g_new0(MemsetThread, context->num_threads);
+    for (i = 0; i < context->num_threads; i++) {
+        context->threads[i].context = context;
+        if (opts->tc) {
+            thread_context_create_thread(opts->tc,
+                                         &context->threads[i].pgthread,
                                          "touch_pages",
-                                         touch_fn, &context.threads[i],
+                                         touch_fn, &context->threads[i],
                                          QEMU_THREAD_JOINABLE);
         } else {
-            qemu_thread_create(&context.threads[i].pgthread, "touch_pages",
-                               touch_fn, &context.threads[i],
+            qemu_thread_create(&context->threads[i].pgthread, "touch_pages",
+                               touch_fn, &context->threads[i],
                                QEMU_THREAD_JOINABLE);
         }
-        addr += context.threads[i].numpages * hpagesize;
     }
 
     if (!use_madv_populate_write) {
-        sigbus_memset_context = &context;
+        sigbus_memset_context = context;
     }
 
     qemu_mutex_lock(&page_mutex);
-    context.all_threads_created = true;
+    context->all_threads_created = true;
     qemu_cond_broadcast(&page_cond);
     qemu_mutex_unlock(&page_mutex);
 
-    for (i = 0; i < context.num_threads; i++) {
-        int tmp = (uintptr_t)qemu_thread_join(&context.threads[i].pgthread);
+    if (async) {
+        /*
+         * The threads keep running; qemu_finish_async_prealloc_mem() will
+         * wait for them and report errors.
+         */
+        QLIST_INSERT_HEAD(&memset_contexts, context, next);
+        return 0;
+    }
+
+    return wait_and_free_mem_prealloc_context(context);
+}
 
-        if (tmp) {
+bool qemu_finish_async_prealloc_mem(Error **errp)
+{
+    MemsetContext *context, *next_context;
+    g_autofree char *failed = NULL;
+    int ret = 0, tmp;
+
+    /* Waiting for preallocation if memory backends had "prealloc=on". */
+    QLIST_FOREACH_SAFE(context, &memset_contexts, next, next_context) {
+        g_autofree char *desc = memset_context_describe(context);
+
+        QLIST_REMOVE(context, next);
+        tmp = wait_and_free_mem_prealloc_context(context);
+        if (tmp && !ret) {
             ret = tmp;
+            failed = g_steal_pointer(&desc);
         }
     }
 
-    if (!use_madv_populate_write) {
-        sigbus_memset_context = NULL;
+    if (ret) {
+        error_setg_errno(errp, -ret,
+                         "qemu_prealloc_mem: preallocating memory %s failed",
+                         failed);
+        return false;
     }
-    g_free(context.threads);
-
-    return ret;
+    return true;
 }
 
 static bool madv_populate_write_possible(char *area, size_t pagesize)
@@ -497,10 +647,12 @@ static bool madv_populate_write_possible(char *area, size_t pagesize)
            errno != EINVAL;
 }
 
-void qemu_prealloc_mem(int fd, char *area, size_t sz, int max_threads,
-                       ThreadContext *tc, Error **errp)
+void qemu_prealloc_mem(int fd, char *area, size_t sz,
+                       const QemuPreallocOptions *opts, Error **errp)
 {
     static gsize initialized;
+    bool async = opts->async;
+    bool collapse;
     int ret;
     size_t hpagesize = qemu_fd_getpagesize(fd);
     size_t numpages = DIV_ROUND_UP(sz, hpagesize);
@@ -514,6 +666,14 @@ void qemu_prealloc_mem(int fd, char *area, size_t sz, int max_threads,
     use_madv_populate_write = madv_populate_write_possible(area, hpagesize);
 
     if (!use_madv_populate_write) {
+        /*
+         * Touching pages reads and writes back their content, which could
+         * race with anybody writing to the area in the meantime. Further,
+         * we'd have to keep our SIGBUS handler installed. Fallback to
+         * synchronous preallocation.
+         */
+        async = false;
+
         if (g_once_init_enter(&initialized)) {
             qemu_mutex_init(&sigbus_mutex);
             g_once_init_leave(&initialized, 1);
@@ -538,9 +698,16 @@ void qemu_prealloc_mem(int fd, char *area, size_t sz, int max_threads,
         }
     }
 
+    /*
+     * Only memory that is not already backed by hugetlb pages can be
+     * collapsed, and it has to be populated without touching it first.
+     */
+    collapse = opts->collapse && use_madv_populate_write &&
+               hpagesize == qemu_real_host_page_size();
+
     /* touch pages simultaneously */
-    ret = touch_all_pages(area, hpagesize, numpages, max_threads, tc,
-                          use_madv_populate_write);
+    ret = touch_all_pages(area, hpagesize, numpages, opts, async,
+                          use_madv_populate_write, collapse);
     if (ret) {
         error_setg_errno(errp, -ret,
                          "qemu_prealloc_mem: preallocating memory failed");
@@ -557,6 +724,76 @@ void qemu_prealloc_mem(int fd, char *area, size_t sz, int max_threads,
     }
 }
 
+#ifdef CONFIG_LINUX
+/*
+ * Account @bytes of huge pages of the VMA [@vma_start, @vma_end) to each
+ * area it overlaps. Where the huge pages lie within the VMA is unknown, so
+ * a partial overlap gets the corresponding share of them.
+ */
+static void qemu_account_thp(QemuThpArea *areas, int nr_areas,
+                             uintptr_t vma_start, uintptr_t vma_end,
+                             uint64_t bytes)
+{
+    uint64_t lo, hi;
+    int i;
+
+    for (i = 0; i < nr_areas; i++) {
+        uintptr_t start = MAX(vma_start, (uintptr_t)areas[i].area);
+        uintptr_t end = MIN(vma_end,
+                            (uintptr_t)areas[i].area + areas[i].size);
+
+        if (start >= end) {
+            continue;
+        }
+        if (end - start == vma_end - vma_start) {
+            areas[i].thp_size += bytes;
+        } else {
+            mulu64(&lo, &hi, bytes, end - start);
+            divu128(&lo, &hi, vma_end - vma_start);
+            areas[i].thp_size += lo;
+        }
+    }
+}
+#endif
+
+bool qemu_get_thp_backed_size(QemuThpArea *areas, int nr_areas)
+{
+#ifdef CONFIG_LINUX
+    g_autofree char *contents = NULL;
+    g_auto(GStrv) lines = NULL;
+    uintptr_t vma_start = 0, vma_end = 0;
+    unsigned long kb;
+    int i;
+
+    for (i = 0; i < nr_areas; i++) {
+        areas[i].thp_size = 0;
+    }
+
+    if (!g_file_get_contents("/proc/self/smaps", &contents, NULL, NULL)) {
+        return false;
+    }
+
+    /* Each VMA starts with its address range, followed by its counters. */
+    lines = g_strsplit(contents, "\n", -1);
+    for (i = 0; lines[i]; i++) {
+        if (sscanf(lines[i], "%" SCNxPTR "-%" SCNxPTR,
+                   &vma_start, &vma_end) == 2) {
+            continue;
+        }
+        if (vma_end > vma_start &&
+            (sscanf(lines[i], "AnonHugePages: %lu kB", &kb) == 1 ||
+             sscanf(lines[i], "ShmemPmdMapped: %lu kB", &kb) == 1 ||
+             sscanf(lines[i], "FilePmdMapped: %lu kB", &kb) == 1)) {
+            qemu_account_thp(areas, nr_areas, vma_start, vma_end,
+                             (uint64_t)kb * KiB);
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
 char *qemu_get_pid_name(pid_t pid)
 {
     char *name = NULL;
@@ -264,8 +264,8 @@ int getpagesize(void)
     return system_info.dwPageSize;
 }
 
-void qemu_prealloc_mem(int fd, char *area, size_t sz, int max_threads,
-                       ThreadContext *tc, Error **errp)
+void qemu_prealloc_mem(int fd, char *area, size_t sz,
+                       const QemuPreallocOptions *opts, Error **errp)
 {
     int i;
     size_t pagesize = qemu_real_host_page_size();
@@ -276,6 +276,17 @@ void qemu_prealloc_mem(int fd, char *area, size_t sz, int max_threads,
     }
 }
 
+bool qemu_finish_async_prealloc_mem(Error **errp)
+{
+    /* Preallocation is always synchronous. */
+    return true;
+}
+
+bool qemu_get_thp_backed_size(QemuThpArea *areas, int nr_areas)
+{
+    return false;
+}
+
 char *qemu_get_pid_name(pid_t pid)
 {
     /* XXX Implement me */